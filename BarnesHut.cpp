@@ -0,0 +1,208 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "BarnesHut.hpp"
+using NB::QuadTree;
+using NB::BodyState;
+
+static const double G = 6.67430e-11;
+
+void QuadTree::build(const BodyState& state) {
+    const size_t n = state.size();
+    _nodes.clear();
+    _next.assign(n, -1);
+    if (n == 0) {
+        return;
+    }
+
+    double minX = state.x[0], maxX = state.x[0];
+    double minY = state.y[0], maxY = state.y[0];
+    for (size_t i = 1; i < n; i++) {
+        minX = std::min(minX, state.x[i]);
+        maxX = std::max(maxX, state.x[i]);
+        minY = std::min(minY, state.y[i]);
+        maxY = std::max(maxY, state.y[i]);
+    }
+    double half = std::max(maxX - minX, maxY - minY) / 2;
+    // Pad the root so bodies on the far edge still fall strictly inside.
+    half = half > 0 ? half * (1 + 1e-6) : 1.0;
+    newNode((minX + maxX) / 2, (minY + maxY) / 2, half);
+
+    for (size_t i = 0; i < n; i++) {
+        double x = state.x[i];
+        double y = state.y[i];
+        int node = 0;
+        int depth = 0;
+
+        while (true) {
+            if (_nodes[node].child >= 0) {
+                node = _nodes[node].child + quadrant(node, x, y);
+                depth++;
+            } else if (_nodes[node].first < 0) {
+                _nodes[node].first = static_cast<int>(i);
+                break;
+            } else if (depth >= kMaxDepth) {
+                // Bodies this close together share one leaf.
+                _next[i] = _nodes[node].first;
+                _nodes[node].first = static_cast<int>(i);
+                break;
+            } else {
+                subdivide(node);
+                int body = _nodes[node].first;
+                _nodes[node].first = -1;
+                int q = quadrant(node, state.x[body], state.y[body]);
+                _nodes[_nodes[node].child + q].first = body;
+            }
+        }
+    }
+
+    // Children are always created after their parent, so a reverse sweep
+    // sees every child before the node that owns it.
+    for (size_t k = _nodes.size(); k-- > 0;) {
+        Node& node = _nodes[k];
+        double mass = 0.0, mx = 0.0, my = 0.0;
+        if (node.child < 0) {
+            for (int b = node.first; b >= 0; b = _next[b]) {
+                mass += state.mass[b];
+                mx += state.mass[b] * state.x[b];
+                my += state.mass[b] * state.y[b];
+            }
+        } else {
+            for (int c = node.child; c < node.child + 4; c++) {
+                mass += _nodes[c].mass;
+                mx += _nodes[c].mass * _nodes[c].comX;
+                my += _nodes[c].mass * _nodes[c].comY;
+            }
+        }
+        node.mass = mass;
+        node.comX = mass > 0 ? mx / mass : node.cx;
+        node.comY = mass > 0 ? my / mass : node.cy;
+    }
+}
+
+QuadTree::Walk QuadTree::acceleration(const BodyState& state, size_t i,
+                                      double theta, double softening2,
+                                      double* ax, double* ay,
+                                      double* potential) const {
+    if (softening2 > 0) {
+        return acceleration<true>(state, i, theta, softening2, ax, ay,
+                                  potential);
+    }
+    return acceleration<false>(state, i, theta, 0.0, ax, ay, potential);
+}
+
+template <bool Softened>
+QuadTree::Walk QuadTree::acceleration(const BodyState& state, size_t i,
+                                      double theta, double softening2,
+                                      double* ax, double* ay,
+                                      double* potential) const {
+    Walk walk;
+    *ax = 0.0;
+    *ay = 0.0;
+    if (potential) {
+        *potential = 0.0;
+    }
+    if (_nodes.empty()) {
+        return walk;
+    }
+    double phi = 0.0;
+
+    const double x = state.x[i];
+    const double y = state.y[i];
+    const double theta2 = theta * theta;
+    int stack[3 * kMaxDepth + 4];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = _nodes[stack[--top]];
+        walk.nodes++;
+        if (node.mass <= 0) {
+            continue;
+        }
+
+        if (node.child < 0) {
+            for (int b = node.first; b >= 0; b = _next[b]) {
+                if (static_cast<size_t>(b) == i) {
+                    continue;
+                }
+                double dx = state.x[b] - x;
+                double dy = state.y[b] - y;
+                double r2 = dx * dx + dy * dy;
+                if constexpr (Softened) {
+                    r2 += softening2;
+                }
+                if (r2 > 0) {
+                    double s = G * state.mass[b] / (r2 * std::sqrt(r2));
+                    *ax += dx * s;
+                    *ay += dy * s;
+                    phi -= s * r2;
+                    walk.interactions++;
+                }
+            }
+            continue;
+        }
+
+        // A cell that holds the body always opens. Its centre of mass can
+        // be far enough away to pass the test for theta above about 0.7,
+        // and accepting the cell would pull the body by its own mass.
+        double dx = node.comX - x;
+        double dy = node.comY - y;
+        double r2 = dx * dx + dy * dy;
+        double size = 2 * node.half;
+        if (size * size < theta2 * r2 &&
+            (std::abs(x - node.cx) > node.half ||
+             std::abs(y - node.cy) > node.half)) {
+            double soft = r2;
+            if constexpr (Softened) {
+                soft += softening2;
+            }
+            double s = G * node.mass / (soft * std::sqrt(soft));
+            *ax += dx * s;
+            *ay += dy * s;
+            phi -= s * soft;
+            walk.interactions++;
+        } else {
+            for (int c = node.child; c < node.child + 4; c++) {
+                stack[top++] = c;
+            }
+        }
+    }
+    if (potential) {
+        *potential = phi;
+    }
+    return walk;
+}
+
+template QuadTree::Walk QuadTree::acceleration<false>(
+    const BodyState&, size_t, double, double, double*, double*,
+    double*) const;
+template QuadTree::Walk QuadTree::acceleration<true>(
+    const BodyState&, size_t, double, double, double*, double*,
+    double*) const;
+
+size_t QuadTree::nodeCount() const { return _nodes.size(); }
+
+const std::vector<QuadTree::Node>& QuadTree::nodes() const { return _nodes; }
+
+int QuadTree::newNode(double cx, double cy, double half) {
+    _nodes.push_back({cx, cy, half, 0.0, cx, cy, -1, -1});
+    return static_cast<int>(_nodes.size() - 1);
+}
+
+void QuadTree::subdivide(int node) {
+    double cx = _nodes[node].cx;
+    double cy = _nodes[node].cy;
+    double h = _nodes[node].half / 2;
+    int first = newNode(cx - h, cy - h, h);
+    newNode(cx + h, cy - h, h);
+    newNode(cx - h, cy + h, h);
+    newNode(cx + h, cy + h, h);
+    _nodes[node].child = first;
+}
+
+int QuadTree::quadrant(int node, double x, double y) const {
+    return (x >= _nodes[node].cx ? 1 : 0) + (y >= _nodes[node].cy ? 2 : 0);
+}
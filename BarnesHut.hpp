@@ -0,0 +1,60 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "BodyState.hpp"
+
+namespace NB {
+// Barnes-Hut quadtree over the bodies of a BodyState. The tree is rebuilt
+// every step into a flat node pool that keeps its capacity, so once it has
+// grown to fit the scene a rebuild does not allocate.
+class QuadTree {
+ public:
+    struct Node {
+        double cx, cy, half;     // square cell: center and half width
+        double mass, comX, comY;  // aggregate mass and center of mass
+        int child;  // index of the first of four children, -1 for a leaf
+        int first;  // first body in a leaf, -1 when empty
+    };
+
+    static constexpr int kMaxDepth = 48;
+
+    // Work done by one acceleration() call.
+    struct Walk {
+        size_t nodes = 0;         // nodes popped
+        size_t interactions = 0;  // force terms summed
+    };
+
+    void build(const BodyState& state);
+
+    // Gravitational acceleration on body i from every other body, opening
+    // every cell whose square contains the body and the others whose size
+    // / distance ratio is at least theta. softening2 is the squared
+    // Plummer softening length, applied to bodies and cells.
+    // If potential is given it receives the gravitational potential at
+    // body i, -sum G m / r over the same terms, which the walk gets for a
+    // multiply-add per term.
+    Walk acceleration(const BodyState& state, size_t i, double theta,
+                      double softening2, double* ax, double* ay,
+                      double* potential = nullptr) const;
+    // The same with softening fixed at compile time, for callers that
+    // choose once for many bodies.
+    template <bool Softened>
+    Walk acceleration(const BodyState& state, size_t i, double theta,
+                      double softening2, double* ax, double* ay,
+                      double* potential = nullptr) const;
+
+    size_t nodeCount() const;
+    const std::vector<Node>& nodes() const;
+
+ private:
+    int newNode(double cx, double cy, double half);
+    void subdivide(int node);
+    int quadrant(int node, double x, double y) const;
+
+    std::vector<Node> _nodes;
+    std::vector<int> _next;  // chains bodies that share a leaf at max depth
+};
+}  // namespace NB
@@ -0,0 +1,149 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "BatchRenderer.hpp"
+#include "TextureCache.hpp"
+using NB::BatchRenderer;
+
+static const unsigned kAtlasWidth = 2048;
+
+void BatchRenderer::rebuild(
+    const std::vector<std::shared_ptr<CelestialBody>>& bodies) {
+    std::unordered_map<std::string, uint32_t> index;
+    std::vector<sf::Image> images;
+    _cellOf.clear();
+    _cellOf.reserve(bodies.size());
+
+    for (const auto& body : bodies) {
+        auto found = index.find(body->filename());
+        if (found == index.end()) {
+            sf::Image image;
+            auto texture = TextureCache::global().get(body->filename());
+            if (texture) {
+                image = texture->copyToImage();
+            } else {
+                image.create(1, 1, sf::Color::White);
+            }
+            found = index.emplace(body->filename(),
+                                  static_cast<uint32_t>(images.size())).first;
+            images.push_back(image);
+        }
+        _cellOf.push_back(found->second);
+    }
+
+    // Shelf packing: images are laid left to right in rows as tall as the
+    // tallest image in the row, with a pixel of padding against bleeding.
+    unsigned width = kAtlasWidth;
+    for (const auto& image : images) {
+        width = std::max(width, image.getSize().x);
+    }
+    unsigned x = 0, y = 0, shelf = 0;
+    _cells.clear();
+    _largestCell = 1.0f;
+    for (const auto& image : images) {
+        sf::Vector2u size = image.getSize();
+        if (x + size.x > width) {
+            x = 0;
+            y += shelf + 1;
+            shelf = 0;
+        }
+        _cells.emplace_back(x, y, size.x, size.y);
+        _largestCell = std::max<float>(_largestCell,
+                                       std::max(size.x, size.y));
+        x += size.x + 1;
+        shelf = std::max(shelf, size.y);
+    }
+
+    sf::Image atlas;
+    atlas.create(width, std::max(1u, y + shelf), sf::Color::Transparent);
+    _colors.clear();
+    for (size_t k = 0; k < images.size(); k++) {
+        atlas.copy(images[k], _cells[k].left, _cells[k].top);
+
+        double r = 0, g = 0, b = 0, weight = 0;
+        sf::Vector2u size = images[k].getSize();
+        for (unsigned py = 0; py < size.y; py++) {
+            for (unsigned px = 0; px < size.x; px++) {
+                sf::Color c = images[k].getPixel(px, py);
+                r += c.r * c.a;
+                g += c.g * c.a;
+                b += c.b * c.a;
+                weight += c.a;
+            }
+        }
+        if (weight > 0) {
+            _colors.emplace_back(r / weight, g / weight, b / weight);
+        } else {
+            _colors.push_back(sf::Color::White);
+        }
+    }
+    _atlas.loadFromImage(atlas);
+}
+
+void BatchRenderer::update(const BodyState& state, float scale,
+                           const std::vector<uint32_t>* slots) {
+    const size_t n = std::min(state.size(), _cellOf.size());
+    auto slot = [slots](size_t i) -> size_t {
+        return slots ? (*slots)[i] : i;
+    };
+
+    if (pointMode()) {
+        _vertices.setPrimitiveType(sf::Points);
+        _vertices.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            sf::Vertex& v = _vertices[i];
+            const size_t s = slot(i);
+            v.position = {static_cast<float>(state.x[s] * scale),
+                          static_cast<float>(state.y[s] * scale)};
+            v.color = _colors[_cellOf[i]];
+        }
+        return;
+    }
+
+    _vertices.setPrimitiveType(sf::Quads);
+    _vertices.resize(4 * n);
+    for (size_t i = 0; i < n; i++) {
+        const sf::FloatRect& cell = _cells[_cellOf[i]];
+        const size_t s = slot(i);
+        float left = static_cast<float>(state.x[s] * scale);
+        float top = static_cast<float>(state.y[s] * scale);
+        float w = cell.width * _bodyScale;
+        float h = cell.height * _bodyScale;
+        sf::Vertex* quad = &_vertices[4 * i];
+
+        quad[0].position = {left, top};
+        quad[1].position = {left + w, top};
+        quad[2].position = {left + w, top + h};
+        quad[3].position = {left, top + h};
+        quad[0].texCoords = {cell.left, cell.top};
+        quad[1].texCoords = {cell.left + cell.width, cell.top};
+        quad[2].texCoords = {cell.left + cell.width, cell.top + cell.height};
+        quad[3].texCoords = {cell.left, cell.top + cell.height};
+        for (int k = 0; k < 4; k++) {
+            quad[k].color = sf::Color::White;
+        }
+    }
+}
+
+void BatchRenderer::setBodyScale(float scale) { _bodyScale = scale; }
+
+float BatchRenderer::bodyScale() const { return _bodyScale; }
+
+bool BatchRenderer::pointMode() const {
+    return _largestCell * _bodyScale < 1.0f;
+}
+
+const sf::VertexArray& BatchRenderer::vertices() const { return _vertices; }
+
+const sf::Texture& BatchRenderer::atlas() const { return _atlas; }
+
+void BatchRenderer::draw(sf::RenderTarget& window,
+                         sf::RenderStates states) const {
+    states.texture = pointMode() ? nullptr : &_atlas;
+    window.draw(_vertices, states);
+}
@@ -0,0 +1,49 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "BodyState.hpp"
+#include "CelestialBody.hpp"
+
+namespace NB {
+// Draws every body with a single draw call. The distinct body images are
+// packed into one atlas texture and each body is a textured quad in one
+// vertex array that is rewritten in place every frame straight from the
+// physics state. When the quads would be smaller than a pixel the bodies
+// are drawn as points in the average color of their image instead.
+class BatchRenderer: public sf::Drawable {
+ public:
+    // Builds the atlas and assigns every body its cell. Needed whenever
+    // bodies are added or removed.
+    void rebuild(const std::vector<std::shared_ptr<CelestialBody>>& bodies);
+
+    // Writes the vertices for the current positions; `scale` maps meters
+    // to pixels as for the sprites. Body i of the list given to rebuild()
+    // is at (*slots)[i] in state, or at i without slots.
+    void update(const BodyState& state, float scale,
+                const std::vector<uint32_t>* slots = nullptr);
+
+    void setBodyScale(float scale);  // quad size relative to image size
+    float bodyScale() const;
+    bool pointMode() const;
+    const sf::VertexArray& vertices() const;
+    const sf::Texture& atlas() const;
+
+ protected:
+    void draw(sf::RenderTarget& window, sf::RenderStates states)
+    const override;
+
+ private:
+    sf::Texture _atlas;
+    std::vector<sf::FloatRect> _cells;  // atlas rectangle per image
+    std::vector<sf::Color> _colors;     // average color per image
+    std::vector<uint32_t> _cellOf;      // image index per body
+    sf::VertexArray _vertices;
+    float _bodyScale = 1.0f;
+    float _largestCell = 1.0f;
+};
+}  // namespace NB
@@ -0,0 +1,176 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "BlockStepper.hpp"
+#include "Profiler.hpp"
+using NB::BlockStepper;
+using NB::BodyState;
+using NB::Metric;
+using NB::Phase;
+using NB::Profiler;
+using NB::ScopedTimer;
+
+static const double G = 6.67430e-11;
+
+void BlockStepper::setMaxLevel(int level) {
+    _maxLevel = std::clamp(level, 0, 30);
+    _ready = false;
+}
+
+void BlockStepper::setAccuracy(double eta) { _eta = eta; }
+
+void BlockStepper::setSoftening(double softening) {
+    _softening2 = softening * softening;
+    _ready = false;
+}
+
+int BlockStepper::maxLevel() const { return _maxLevel; }
+
+double BlockStepper::accuracy() const { return _eta; }
+
+void BlockStepper::reset() { _ready = false; }
+
+const std::vector<uint8_t>& BlockStepper::levels() const { return _level; }
+
+size_t BlockStepper::step(BodyState& state, double dt, ThreadPool* pool) {
+    const size_t n = state.size();
+    size_t evaluations = 0;
+
+    if (!_ready || _revision != state.revision || _level.size() != n) {
+        _level.assign(n, 0);
+        _jx.assign(n, 0.0);
+        _jy.assign(n, 0.0);
+        _active.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            _active[i] = static_cast<uint32_t>(i);
+        }
+        accelerate(state, pool);
+        evaluations += n;
+        for (size_t i = 0; i < n; i++) {
+            _level[i] = static_cast<uint8_t>(chooseLevel(state, i, dt));
+        }
+        _ready = true;
+    }
+
+    const uint64_t ticks = uint64_t(1) << _maxLevel;
+    const double h = dt / static_cast<double>(ticks);
+
+    for (uint64_t t = 0; t < ticks; t++) {
+        for (size_t i = 0; i < n; i++) {
+            uint64_t stride = uint64_t(1) << (_maxLevel - _level[i]);
+            if (t % stride == 0) {
+                double half = h * static_cast<double>(stride) / 2;
+                state.vx[i] += state.ax[i] * half;
+                state.vy[i] += state.ay[i] * half;
+            }
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            state.x[i] += state.vx[i] * h;
+            state.y[i] += state.vy[i] * h;
+        }
+
+        _active.clear();
+        for (size_t i = 0; i < n; i++) {
+            uint64_t stride = uint64_t(1) << (_maxLevel - _level[i]);
+            if ((t + 1) % stride == 0) {
+                _active.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        if (_active.empty()) {
+            continue;
+        }
+
+        accelerate(state, pool);
+        evaluations += _active.size();
+
+        for (uint32_t i : _active) {
+            uint64_t stride = uint64_t(1) << (_maxLevel - _level[i]);
+            double half = h * static_cast<double>(stride) / 2;
+            state.vx[i] += state.ax[i] * half;
+            state.vy[i] += state.ay[i] * half;
+
+            // A body may always move to a finer level; it may move up by one
+            // level only where that coarser step would also end.
+            int wanted = chooseLevel(state, i, dt);
+            int level = _level[i];
+            if (wanted > level) {
+                level = wanted;
+            } else if (wanted < level) {
+                uint64_t coarser = stride << 1;
+                if ((t + 1) % coarser == 0) {
+                    level--;
+                }
+            }
+            _level[i] = static_cast<uint8_t>(level);
+        }
+    }
+
+    _revision = state.revision;
+    return evaluations;
+}
+
+// Acceleration and jerk of every active body from all bodies.
+void BlockStepper::accelerate(BodyState& state, ThreadPool* pool) {
+    ScopedTimer timer(Phase::Forces);
+    const size_t n = state.size();
+    Profiler::count(Metric::Interactions,
+                    n > 0 ? _active.size() * (n - 1) : 0);
+    const double* x = state.x.data();
+    const double* y = state.y.data();
+    const double* vx = state.vx.data();
+    const double* vy = state.vy.data();
+    const double* m = state.mass.data();
+
+    auto body = [&](size_t begin, size_t end, size_t) {
+        for (size_t k = begin; k < end; k++) {
+            const size_t i = _active[k];
+            double ax = 0.0, ay = 0.0, jx = 0.0, jy = 0.0;
+            for (size_t j = 0; j < n; j++) {
+                if (j == i) {
+                    continue;
+                }
+                double dx = x[j] - x[i];
+                double dy = y[j] - y[i];
+                double dvx = vx[j] - vx[i];
+                double dvy = vy[j] - vy[i];
+                double r2 = dx * dx + dy * dy + _softening2;
+                double inv2 = 1.0 / r2;
+                double s = G * m[j] * inv2 * std::sqrt(inv2);
+                double rv = 3.0 * (dx * dvx + dy * dvy) * inv2;
+                ax += s * dx;
+                ay += s * dy;
+                jx += s * (dvx - rv * dx);
+                jy += s * (dvy - rv * dy);
+            }
+            state.ax[i] = ax;
+            state.ay[i] = ay;
+            _jx[i] = jx;
+            _jy[i] = jy;
+        }
+    };
+
+    if (pool) {
+        pool->parallelFor(0, _active.size(), 16, body);
+    } else {
+        body(0, _active.size(), 0);
+    }
+}
+
+int BlockStepper::chooseLevel(const BodyState& state, size_t i,
+                              double dt) const {
+    double a = std::hypot(state.ax[i], state.ay[i]);
+    double j = std::hypot(_jx[i], _jy[i]);
+    if (j <= 0 || a <= 0) {
+        return 0;
+    }
+    double wanted = _eta * a / j;
+    if (wanted >= dt) {
+        return 0;
+    }
+    int level = static_cast<int>(std::ceil(std::log2(dt / wanted)));
+    return std::clamp(level, 0, _maxLevel);
+}
@@ -0,0 +1,51 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "BodyState.hpp"
+#include "ThreadPool.hpp"
+
+namespace NB {
+// Hierarchical power-of-two block time steps. A call to step(dt) splits dt
+// into 2^maxLevel ticks; a body on level l advances with its own step
+// dt / 2^l using kick-drift-kick leapfrog, so it is kicked only at the
+// ticks where its step begins or ends. Every tick drifts all bodies, but
+// forces (and jerks) are recomputed only for the bodies whose step ends
+// there. Levels follow Aarseth's criterion dt_i = eta |a_i| / |jerk_i|.
+// Forces use the exact pair sum, restricted to the active bodies.
+class BlockStepper {
+ public:
+    void setMaxLevel(int level);
+    void setAccuracy(double eta);
+    void setSoftening(double softening);  // Plummer softening length
+    int maxLevel() const;
+    double accuracy() const;
+
+    // Forget the cached accelerations and levels, e.g. after the state was
+    // changed from outside.
+    void reset();
+
+    // Advances the state by dt and returns the number of per-body force
+    // evaluations it took. pool may be null.
+    size_t step(BodyState& state, double dt, ThreadPool* pool);
+
+    const std::vector<uint8_t>& levels() const;
+
+ private:
+    void accelerate(BodyState& state, ThreadPool* pool);
+    int chooseLevel(const BodyState& state, size_t i, double dt) const;
+
+    int _maxLevel = 8;
+    double _eta = 0.02;
+    double _softening2 = 0.0;
+    bool _ready = false;
+    size_t _revision = 0;
+    std::vector<uint8_t> _level;
+    std::vector<uint32_t> _active;
+    AlignedVector<double> _jx;
+    AlignedVector<double> _jy;
+};
+}  // namespace NB
@@ -0,0 +1,52 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <cstddef>
+#include "BodyState.hpp"
+using NB::BodyState;
+
+size_t BodyState::size() const { return mass.size(); }
+
+void BodyState::reserve(size_t n) {
+    x.reserve(n);
+    y.reserve(n);
+    vx.reserve(n);
+    vy.reserve(n);
+    ax.reserve(n);
+    ay.reserve(n);
+    mass.reserve(n);
+}
+
+void BodyState::clear() {
+    x.clear();
+    y.clear();
+    vx.clear();
+    vy.clear();
+    ax.clear();
+    ay.clear();
+    mass.clear();
+    revision++;
+}
+
+void BodyState::resize(size_t n) {
+    x.resize(n);
+    y.resize(n);
+    vx.resize(n);
+    vy.resize(n);
+    ax.resize(n);
+    ay.resize(n);
+    mass.resize(n);
+    revision++;
+}
+
+size_t BodyState::push(double m, double px, double py,
+                       double pvx, double pvy) {
+    x.push_back(px);
+    y.push_back(py);
+    vx.push_back(pvx);
+    vy.push_back(pvy);
+    ax.push_back(0.0);
+    ay.push_back(0.0);
+    mass.push_back(m);
+    revision++;
+    return mass.size() - 1;
+}
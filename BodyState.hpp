@@ -0,0 +1,73 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace NB {
+// Allocator that hands out cache-line aligned storage so the physics
+// arrays can be streamed with wide vector loads.
+template <typename T, std::size_t Alignment = 64>
+class AlignedAllocator {
+ public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() noexcept = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        std::size_t bytes = (n * sizeof(T) + Alignment - 1)
+        / Alignment * Alignment;
+        return static_cast<T*>(
+            ::operator new(bytes, std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* ptr, std::size_t) noexcept {
+        ::operator delete(ptr, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept {
+        return false;
+    }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Slot of a body that is no longer in the state arrays.
+constexpr uint32_t kNoSlot = UINT32_MAX;
+
+// Structure-of-arrays physics state for every body in a Universe.
+// Index i in each array belongs to the same body.
+struct BodyState {
+    AlignedVector<double> x;
+    AlignedVector<double> y;
+    AlignedVector<double> vx;
+    AlignedVector<double> vy;
+    AlignedVector<double> ax;
+    AlignedVector<double> ay;
+    AlignedVector<double> mass;
+    // Bumped on every write from outside the integrator so cached
+    // accelerations can tell they are stale.
+    size_t revision = 0;
+
+    size_t size() const;
+    void reserve(size_t n);
+    void clear();
+    void resize(size_t n);  // keeps the first n bodies when shrinking
+    size_t push(double m, double px, double py, double pvx, double pvy);
+};
+}  // namespace NB
@@ -7,6 +7,7 @@
 #include <SFML/Graphics.hpp>
 #include "Universe.hpp"
 #include "CelestialBody.hpp"
+#include "TextureCache.hpp"
 using NB::Universe;
 using NB::CelestialBody;
 
@@ -18,43 +19,110 @@ CelestialBody::CelestialBody(float mass): _mass(mass) {}
 CelestialBody::CelestialBody(float mass, sf::Vector2f position,
                             sf::Vector2f velocity, std::string fileName) {
     _mass = mass;
-    _position = position;
-    _velocity = velocity;
+    _position = sf::Vector2<double>(position);
+    _velocity = sf::Vector2<double>(velocity);
     _force = {0.0, 0.0};
     _acceleration = {0.0, 0.0};
     _fileName = fileName;
-    _texture = std::make_shared<sf::Texture>();
-
-    if (!_texture->loadFromFile(_fileName)) {
-        std::cout << "Error loading image to texture." << std::endl;
-        exit(1);
-    } else {
+    if (!loadTextures()) {
+        return;
+    }
+    // An image that cannot be loaded leaves the sprite untextured; callers
+    // find out through hasTexture().
+    _texture = NB::TextureCache::global().get(_fileName);
+    if (_texture) {
         _sprite.setTexture(*_texture);
     }
 }
 
-sf::Vector2f CelestialBody::position() const { return _position; }
+sf::Vector2f CelestialBody::position() const {
+    return sf::Vector2f(precisePosition());
+}
 
-sf::Vector2f CelestialBody::velocity() const { return _velocity; }
+sf::Vector2f CelestialBody::velocity() const {
+    return sf::Vector2f(preciseVelocity());
+}
+
+float CelestialBody::mass() const { return preciseMass(); }
 
-float CelestialBody::mass() const { return _mass; }
+sf::Vector2<double> CelestialBody::precisePosition() const {
+    if (_state) {
+        return {_state->x[_index], _state->y[_index]};
+    }
+    return _position;
+}
+
+sf::Vector2<double> CelestialBody::preciseVelocity() const {
+    if (_state) {
+        return {_state->vx[_index], _state->vy[_index]};
+    }
+    return _velocity;
+}
+
+double CelestialBody::preciseMass() const {
+    return _state ? _state->mass[_index] : _mass;
+}
 
 sf::Sprite& CelestialBody::sprite() { return _sprite; }
 
-std::string CelestialBody::filename() const { return _fileName; }
+bool CelestialBody::hasTexture() const { return _texture != nullptr; }
 
-sf::Vector2<double> CelestialBody::force() const { return _force; }
+const std::string& CelestialBody::filename() const { return _fileName; }
+
+sf::Vector2<double> CelestialBody::force() const {
+    if (_state) {
+        return acceleration() * preciseMass();
+    }
+    return _force;
+}
+
+sf::Vector2<double> CelestialBody::acceleration() const {
+    if (_state) {
+        return {_state->ax[_index], _state->ay[_index]};
+    }
+    return _acceleration;
+}
 
-sf::Vector2<double> CelestialBody::acceleration()
-const { return _acceleration; }
 
 
+void CelestialBody::setPosition(sf::Vector2f position) {
+    setPrecisePosition(sf::Vector2<double>(position));
+}
+
+void CelestialBody::setVelocity(sf::Vector2f velocity) {
+    setPreciseVelocity(sf::Vector2<double>(velocity));
+}
 
-void CelestialBody::setPosition(sf::Vector2f position) { _position = position; }
+void CelestialBody::setMass(float mass) { setPreciseMass(mass); }
+
+void CelestialBody::setPrecisePosition(sf::Vector2<double> position) {
+    if (_state) {
+        _state->x[_index] = position.x;
+        _state->y[_index] = position.y;
+        _state->revision++;
+    } else {
+        _position = position;
+    }
+}
 
-void CelestialBody::setVelocity(sf::Vector2f velocity) { _velocity = velocity; }
+void CelestialBody::setPreciseVelocity(sf::Vector2<double> velocity) {
+    if (_state) {
+        _state->vx[_index] = velocity.x;
+        _state->vy[_index] = velocity.y;
+        _state->revision++;
+    } else {
+        _velocity = velocity;
+    }
+}
 
-void CelestialBody::setMass(float mass) { _mass = mass; }
+void CelestialBody::setPreciseMass(double mass) {
+    if (_state) {
+        _state->mass[_index] = mass;
+        _state->revision++;
+    } else {
+        _mass = mass;
+    }
+}
 
 void CelestialBody::setFileName(std::string filename) { _fileName = filename; }
 
@@ -64,14 +132,59 @@ void CelestialBody::setTexture(std::shared_ptr<sf::Texture> texture)
 void CelestialBody::setSprite(sf::Sprite sprite) { _sprite = sprite; }
 
 void CelestialBody::updateSpritePosition(float scale) {
-    sf::Vector2f scaledPosition = _position * scale;
+    sf::Vector2f scaledPosition = position() * scale;
     _sprite.setPosition(scaledPosition);
 }
 
-void CelestialBody::setForce(sf::Vector2<double> force) { _force = force; }
+void CelestialBody::setForce(sf::Vector2<double> force) {
+    if (_state) {
+        setAcceleration(force / preciseMass());
+    } else {
+        _force = force;
+    }
+}
 
-void CelestialBody::setAcceleration(sf::Vector2<double> acceleration)
-{ _acceleration = acceleration; }
+void CelestialBody::setAcceleration(sf::Vector2<double> acceleration) {
+    if (_state) {
+        _state->ax[_index] = acceleration.x;
+        _state->ay[_index] = acceleration.y;
+        _state->revision++;
+    } else {
+        _acceleration = acceleration;
+    }
+}
+
+void CelestialBody::setLoadTextures(bool enabled) {
+    NB::TextureCache::global().setEnabled(enabled);
+}
+
+bool CelestialBody::loadTextures() {
+    return NB::TextureCache::global().enabled();
+}
+
+void CelestialBody::bind(BodyState* state, size_t index) {
+    _state = state;
+    _index = index;
+}
+
+// Copies the current values out of the arrays so the body stays valid
+// after the owning Universe is gone.
+void CelestialBody::unbind() {
+    if (!_state) {
+        return;
+    }
+    _mass = preciseMass();
+    _position = precisePosition();
+    _velocity = preciseVelocity();
+    _acceleration = acceleration();
+    _force = _acceleration * _mass;
+    _state = nullptr;
+    _index = 0;
+}
+
+bool CelestialBody::isBound() const { return _state != nullptr; }
+
+size_t CelestialBody::index() const { return _index; }
 
 void CelestialBody::draw(sf::RenderTarget& window,
                         sf::RenderStates states) const {
@@ -80,30 +193,34 @@ void CelestialBody::draw(sf::RenderTarget& window,
 
 namespace NB {
 std::istream& operator>>(std::istream& is, CelestialBody& uni) {
-    float mass = 0;
-    sf::Vector2f position = {0, 0};
-    sf::Vector2f velocity = {0, 0};
+    double mass = 0;
+    sf::Vector2<double> position = {0, 0};
+    sf::Vector2<double> velocity = {0, 0};
     std::string filename;
 
     is >> position.x >> position.y >>
     velocity.x >> velocity.y >> mass >> filename;
 
-    uni.setMass(mass);
-    uni.setPosition(position);
-    uni.setVelocity(velocity);
+    uni.setPreciseMass(mass);
+    uni.setPrecisePosition(position);
+    uni.setPreciseVelocity(velocity);
     uni.setFileName(filename);
+    if (!CelestialBody::loadTextures()) {
+        return is;
+    }
 
-    std::shared_ptr<sf::Texture> texture = std::make_shared<sf::Texture>();
+    std::shared_ptr<sf::Texture> texture =
+    NB::TextureCache::global().get(filename);
 
-    if (!texture->loadFromFile(filename)) {
-        std::cout << "Error loading image to texture." << std::endl;
-        exit(1);
+    if (!texture) {
+        is.setstate(std::ios::failbit);
+        return is;
     }
 
     uni.setTexture(texture);
     sf::Sprite sprite;
     sprite.setTexture(*texture);
-    sprite.setPosition(position);
+    sprite.setPosition(sf::Vector2f(position));
     uni.setSprite(sprite);
 
     return is;
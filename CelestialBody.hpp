@@ -7,8 +7,12 @@
 #include <memory>
 #include <cmath>
 #include <SFML/Graphics.hpp>
+#include "BodyState.hpp"
 
 namespace NB {
+// A body is either standalone, holding its own physics values, or bound
+// to a slot in a Universe's BodyState, in which case it is a view onto
+// those arrays and only keeps the render data (file name, sprite) itself.
 class CelestialBody: public sf::Drawable {
  public:
     explicit CelestialBody();
@@ -19,8 +23,16 @@ class CelestialBody: public sf::Drawable {
     sf::Vector2f position() const;  // Optional
     sf::Vector2f velocity() const;  // Optional
     float mass() const;  // Optional
+    // Full double-precision physics values; the float accessors above
+    // round these for display and the text format.
+    sf::Vector2<double> precisePosition() const;
+    sf::Vector2<double> preciseVelocity() const;
+    double preciseMass() const;
     sf::Sprite& sprite();
-    std::string filename() const;
+    const std::string& filename() const;
+    // False when textures are off or the image could not be loaded; the
+    // body then draws nothing. operator>> sets failbit when it could not.
+    bool hasTexture() const;
     sf::Vector2<double> force() const;
     sf::Vector2<double> acceleration() const;
 
@@ -28,25 +40,40 @@ class CelestialBody: public sf::Drawable {
     void setVelocity(sf::Vector2f velocity);
     void setFileName(std::string filename);
     void setMass(float mass);
+    void setPrecisePosition(sf::Vector2<double> position);
+    void setPreciseVelocity(sf::Vector2<double> velocity);
+    void setPreciseMass(double mass);
     void setTexture(std::shared_ptr<sf::Texture> texture);
     void setSprite(sf::Sprite sprite);
     void updateSpritePosition(float scale);
     void setForce(sf::Vector2<double> force);
     void setAcceleration(sf::Vector2<double> acceleration);
 
+    // Headless runs turn texture loading off; bodies then carry only
+    // their file name and an empty sprite. Forwards to TextureCache.
+    static void setLoadTextures(bool enabled);
+    static bool loadTextures();
+
+    void bind(BodyState* state, size_t index);
+    void unbind();
+    bool isBound() const;
+    size_t index() const;
+
  protected:
     void draw(sf::RenderTarget& window,
       sf::RenderStates states) const override;  // From sf::Drawable
 
  private:
-    float _mass;
-    sf::Vector2f _position;
-    sf::Vector2f _velocity;
+    double _mass;
+    sf::Vector2<double> _position;
+    sf::Vector2<double> _velocity;
     sf::Vector2<double> _force;
     sf::Vector2<double> _acceleration;
     std::string _fileName;
     std::shared_ptr<sf::Texture> _texture;
     sf::Sprite _sprite;
+    BodyState* _state = nullptr;
+    size_t _index = 0;
     // Fields and helper methods go here
 };
 
@@ -0,0 +1,108 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "CollisionGrid.hpp"
+using NB::BodyState;
+using NB::CollisionGrid;
+
+double CollisionGrid::radiusFor(double mass, double density) {
+    return std::cbrt(3.0 * mass / (4.0 * M_PI * density));
+}
+
+size_t CollisionGrid::rebuilds() const { return _rebuilds; }
+
+size_t CollisionGrid::bucket(int64_t cx, int64_t cy) const {
+    uint64_t h = static_cast<uint64_t>(cx) * 0x9E3779B97F4A7C15ull
+               ^ static_cast<uint64_t>(cy) * 0xC2B2AE3D27D4EB4Full;
+    return (h ^ (h >> 29)) & _mask;
+}
+
+const std::vector<CollisionGrid::Pair>&
+CollisionGrid::overlaps(const BodyState& state, double density) {
+    const size_t n = state.size();
+    _pairs.clear();
+    if (n < 2) {
+        return _pairs;
+    }
+
+    double largest = 0.0;
+    _radius.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        _radius[i] = radiusFor(state.mass[i], density);
+        largest = std::max(largest, _radius[i]);
+    }
+    if (largest <= 0.0) {
+        return _pairs;
+    }
+
+    const double cell = 2.0 * largest;
+    bool rebuild = cell != _cell || _cx.size() != n;
+    _cell = cell;
+    _cx.resize(n);
+    _cy.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        int64_t cx = static_cast<int64_t>(std::floor(state.x[i] / cell));
+        int64_t cy = static_cast<int64_t>(std::floor(state.y[i] / cell));
+        if (cx != _cx[i] || cy != _cy[i]) {
+            _cx[i] = cx;
+            _cy[i] = cy;
+            rebuild = true;
+        }
+    }
+
+    if (rebuild) {
+        size_t buckets = 1;
+        while (buckets < 2 * n) {
+            buckets <<= 1;
+        }
+        _mask = buckets - 1;
+        _start.assign(buckets + 1, 0);
+        for (size_t i = 0; i < n; i++) {
+            _start[bucket(_cx[i], _cy[i]) + 1]++;
+        }
+        for (size_t b = 0; b < buckets; b++) {
+            _start[b + 1] += _start[b];
+        }
+        // Fill back to front so each bucket ends up in ascending order.
+        _order.resize(n);
+        for (size_t i = n; i-- > 0;) {
+            size_t b = bucket(_cx[i], _cy[i]);
+            _order[_start[b + 1] - 1] = static_cast<uint32_t>(i);
+            _start[b + 1]--;
+        }
+        // _start[b + 1] now holds the start of bucket b; shift it back.
+        for (size_t b = 0; b < buckets; b++) {
+            _start[b] = _start[b + 1];
+        }
+        _start[buckets] = static_cast<uint32_t>(n);
+        _rebuilds++;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        for (int64_t dx = -1; dx <= 1; dx++) {
+            for (int64_t dy = -1; dy <= 1; dy++) {
+                const int64_t cx = _cx[i] + dx;
+                const int64_t cy = _cy[i] + dy;
+                const size_t b = bucket(cx, cy);
+                for (uint32_t k = _start[b]; k < _start[b + 1]; k++) {
+                    const uint32_t j = _order[k];
+                    // Other cells sharing the bucket are skipped, which
+                    // also keeps a bucket reached twice from reporting a
+                    // pair twice.
+                    if (j <= i || _cx[j] != cx || _cy[j] != cy) {
+                        continue;
+                    }
+                    double ddx = state.x[j] - state.x[i];
+                    double ddy = state.y[j] - state.y[i];
+                    double reach = _radius[i] + _radius[j];
+                    if (ddx * ddx + ddy * ddy < reach * reach) {
+                        _pairs.emplace_back(static_cast<uint32_t>(i), j);
+                    }
+                }
+            }
+        }
+    }
+    return _pairs;
+}
@@ -0,0 +1,43 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "BodyState.hpp"
+
+namespace NB {
+// Finds overlapping bodies in O(n). Bodies are spheres of uniform density,
+// binned into a uniform grid of cells twice the largest radius, so a body
+// can only touch bodies in its own or the eight neighbouring cells. Cells
+// are hashed into 2n buckets and the bodies counting-sorted by bucket; when
+// no body has changed cell since the previous call, the previous sort is
+// reused. All buffers are kept between calls.
+class CollisionGrid {
+ public:
+    using Pair = std::pair<uint32_t, uint32_t>;
+
+    static double radiusFor(double mass, double density);
+
+    // Every pair (i, j), i < j, whose spheres overlap.
+    const std::vector<Pair>& overlaps(const BodyState& state,
+                                      double density);
+
+    size_t rebuilds() const;  // calls that had to re-sort the bodies
+
+ private:
+    size_t bucket(int64_t cx, int64_t cy) const;
+
+    double _cell = 0.0;
+    size_t _mask = 0;
+    std::vector<double> _radius;
+    std::vector<int64_t> _cx;
+    std::vector<int64_t> _cy;
+    std::vector<uint32_t> _start;  // first sorted slot of each bucket
+    std::vector<uint32_t> _order;  // bodies sorted by bucket
+    std::vector<Pair> _pairs;
+    size_t _rebuilds = 0;
+};
+}  // namespace NB
@@ -0,0 +1,138 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <cmath>
+#include <ostream>
+#include "Conservation.hpp"
+using NB::BodyState;
+using NB::Conservation;
+using NB::ConservationMonitor;
+
+// Change of value from reference relative to scale, or the absolute change
+// when the scale is zero.
+static double drift(double value, double reference, double scale) {
+    double change = std::abs(value - reference);
+    return scale > 0 ? change / scale : change;
+}
+
+namespace NB {
+double Conservation::energy() const { return kinetic + potential; }
+
+void measureMotion(const BodyState& state, Conservation* conservation) {
+    double kinetic = 0.0, px = 0.0, py = 0.0, angular = 0.0;
+    double momentumScale = 0.0, angularScale = 0.0;
+    for (size_t i = 0; i < state.size(); i++) {
+        const double m = state.mass[i];
+        const double vx = state.vx[i];
+        const double vy = state.vy[i];
+        const double v2 = vx * vx + vy * vy;
+        const double l = m * (state.x[i] * vy - state.y[i] * vx);
+        kinetic += 0.5 * m * v2;
+        px += m * vx;
+        py += m * vy;
+        angular += l;
+        momentumScale += m * std::sqrt(v2);
+        angularScale += std::abs(l);
+    }
+    conservation->kinetic = kinetic;
+    conservation->px = px;
+    conservation->py = py;
+    conservation->angular = angular;
+    conservation->momentumScale = momentumScale;
+    conservation->angularScale = angularScale;
+}
+}  // namespace NB
+
+void ConservationMonitor::setEnergyTolerance(double tolerance) {
+    _energyTolerance = tolerance;
+}
+
+void ConservationMonitor::setMomentumTolerance(double tolerance) {
+    _momentumTolerance = tolerance;
+}
+
+void ConservationMonitor::setAbort(bool abort) { _abort = abort; }
+
+double ConservationMonitor::energyTolerance() const {
+    return _energyTolerance;
+}
+
+double ConservationMonitor::momentumTolerance() const {
+    return _momentumTolerance;
+}
+
+ConservationMonitor::Verdict ConservationMonitor::check(
+    const Conservation& sample, double time, uint64_t step,
+    std::ostream& out) {
+    if (_samples++ == 0) {
+        _reference = sample;
+    } else if (sample.merges != _reference.merges) {
+        out << "Conservation reference reset at step " << step << " after "
+            << sample.merges - _reference.merges << " merges\n";
+        _reference = sample;
+    }
+    const Conservation& ref = _reference;
+    _energyDrift = drift(sample.energy(), ref.energy(),
+                         std::abs(ref.energy()));
+    _momentumDrift = std::hypot(sample.px - ref.px, sample.py - ref.py);
+    if (ref.momentumScale > 0) {
+        _momentumDrift /= ref.momentumScale;
+    }
+    _angularDrift = drift(sample.angular, ref.angular, ref.angularScale);
+
+    out << "Conservation at step " << step << ", time " << time
+        << ": energy " << sample.energy() << " (drift " << _energyDrift
+        << "), momentum drift " << _momentumDrift
+        << ", angular momentum drift " << _angularDrift << "\n";
+
+    const char* quantity = nullptr;
+    double value = 0.0, tolerance = 0.0;
+    if (_energyTolerance > 0 && _energyDrift > _energyTolerance) {
+        quantity = "energy";
+        value = _energyDrift;
+        tolerance = _energyTolerance;
+    } else if (_momentumTolerance > 0 &&
+               _momentumDrift > _momentumTolerance) {
+        quantity = "momentum";
+        value = _momentumDrift;
+        tolerance = _momentumTolerance;
+    } else if (_momentumTolerance > 0 &&
+               _angularDrift > _momentumTolerance) {
+        quantity = "angular momentum";
+        value = _angularDrift;
+        tolerance = _momentumTolerance;
+    }
+    if (!quantity) {
+        return Verdict::Ok;
+    }
+    if (_abort) {
+        out << "Error: " << quantity << " drift " << value << " exceeds "
+            << tolerance << " at step " << step << "; stopping the run\n";
+        return Verdict::Abort;
+    }
+    if (!_warned) {
+        out << "Warning: " << quantity << " drift " << value << " exceeds "
+            << tolerance << " at step " << step << "\n";
+        _warned = true;
+    }
+    return Verdict::Flagged;
+}
+
+void ConservationMonitor::reset() {
+    _samples = 0;
+    _warned = false;
+    _energyDrift = 0.0;
+    _momentumDrift = 0.0;
+    _angularDrift = 0.0;
+}
+
+size_t ConservationMonitor::samples() const { return _samples; }
+
+const Conservation& ConservationMonitor::reference() const {
+    return _reference;
+}
+
+double ConservationMonitor::energyDrift() const { return _energyDrift; }
+
+double ConservationMonitor::momentumDrift() const { return _momentumDrift; }
+
+double ConservationMonitor::angularDrift() const { return _angularDrift; }
@@ -0,0 +1,73 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include "BodyState.hpp"
+
+namespace NB {
+// What an isolated system conserves, measured at one instant. Angular
+// momentum is taken about the origin. The scales sum the magnitudes of the
+// bodies' own terms and measure momentum drift, since the totals are often
+// close to zero.
+struct Conservation {
+    double kinetic = 0.0;
+    double potential = 0.0;
+    double px = 0.0, py = 0.0;   // linear momentum
+    double angular = 0.0;        // x py - y px, summed
+    double momentumScale = 0.0;  // sum of m |v|
+    double angularScale = 0.0;   // sum of m |x vy - y vx|
+    size_t merges = 0;           // bodies absorbed by collisions so far
+
+    double energy() const;
+};
+
+// Sets the kinetic energy, momenta and scales of state in conservation, in
+// one pass over the bodies. The potential is left to the caller, who gets
+// it from a force pass.
+void measureMotion(const BodyState& state, Conservation* conservation);
+
+// Compares measurements with the first one it was given. The energy drift
+// is |E - E0| / |E0|; the momentum drifts are the change of the total over
+// the first measurement's scale. A drift past its tolerance is reported
+// once as a warning, or stops the run when abort is set. A tolerance of 0
+// turns its check off. Merges are inelastic, so a sample taken after more
+// merges than the reference becomes the new reference.
+class ConservationMonitor {
+ public:
+    enum class Verdict { Ok, Flagged, Abort };
+
+    void setEnergyTolerance(double tolerance);
+    // Applies to linear and angular momentum.
+    void setMomentumTolerance(double tolerance);
+    void setAbort(bool abort);
+    double energyTolerance() const;
+    double momentumTolerance() const;
+
+    // Writes one line about sample to out, plus a warning or an error when
+    // a drift is past its tolerance. Returns Abort if the run should stop.
+    Verdict check(const Conservation& sample, double time, uint64_t step,
+                  std::ostream& out);
+    // Forget the reference measurement; the next check sets a new one.
+    void reset();
+
+    size_t samples() const;
+    const Conservation& reference() const;
+    double energyDrift() const;  // of the latest sample
+    double momentumDrift() const;
+    double angularDrift() const;
+
+ private:
+    double _energyTolerance = 0.0;
+    double _momentumTolerance = 0.0;
+    bool _abort = false;
+    bool _warned = false;  // a warning has been written
+    size_t _samples = 0;
+    Conservation _reference;
+    double _energyDrift = 0.0;
+    double _momentumDrift = 0.0;
+    double _angularDrift = 0.0;
+};
+}  // namespace NB
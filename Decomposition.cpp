@@ -0,0 +1,92 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <vector>
+#include "Decomposition.hpp"
+using NB::BodyState;
+using NB::Domain;
+using NB::PointMass;
+using NB::QuadTree;
+
+bool Domain::empty() const { return x1 < x0 || y1 < y0; }
+
+bool Domain::contains(double x, double y) const {
+    return x >= x0 && x < x1 && y >= y0 && y < y1;
+}
+
+double Domain::distance2(double x, double y) const {
+    double dx = std::max({x0 - x, 0.0, x - x1});
+    double dy = std::max({y0 - y, 0.0, y - y1});
+    return dx * dx + dy * dy;
+}
+
+namespace NB {
+Domain boundingDomain(const BodyState& state) {
+    Domain domain;
+    if (state.size() == 0) {
+        return domain;
+    }
+    domain.x0 = domain.x1 = state.x[0];
+    domain.y0 = domain.y1 = state.y[0];
+    for (size_t i = 1; i < state.size(); i++) {
+        domain.x0 = std::min(domain.x0, state.x[i]);
+        domain.x1 = std::max(domain.x1, state.x[i]);
+        domain.y0 = std::min(domain.y0, state.y[i]);
+        domain.y1 = std::max(domain.y1, state.y[i]);
+    }
+    return domain;
+}
+
+size_t owningDomain(const std::vector<Domain>& domains, double x, double y) {
+    size_t nearest = 0;
+    double best = std::numeric_limits<double>::infinity();
+    for (size_t d = 0; d < domains.size(); d++) {
+        if (domains[d].empty()) {
+            continue;
+        }
+        if (domains[d].contains(x, y)) {
+            return d;
+        }
+        double d2 = domains[d].distance2(x, y);
+        if (d2 < best) {
+            best = d2;
+            nearest = d;
+        }
+    }
+    return nearest;
+}
+
+void essentialPoints(const QuadTree& tree, const Domain& target,
+                     double theta, std::vector<PointMass>* out) {
+    const std::vector<QuadTree::Node>& nodes = tree.nodes();
+    if (nodes.empty() || target.empty()) {
+        return;
+    }
+
+    const double theta2 = theta * theta;
+    int stack[3 * QuadTree::kMaxDepth + 4];
+    int top = 0;
+    stack[top++] = 0;
+
+    // The same test as QuadTree::acceleration, from the nearest body the
+    // target could hold; a leaf goes as its monopole, which for the one
+    // body it holds (or a pile at the depth limit) is exact.
+    while (top > 0) {
+        const QuadTree::Node& node = nodes[stack[--top]];
+        if (node.mass <= 0) {
+            continue;
+        }
+        double size = 2 * node.half;
+        if (node.child < 0 ||
+            size * size < theta2 * target.distance2(node.comX, node.comY)) {
+            out->push_back({node.mass, node.comX, node.comY});
+            continue;
+        }
+        for (int c = node.child; c < node.child + 4; c++) {
+            stack[top++] = c;
+        }
+    }
+}
+}  // namespace NB
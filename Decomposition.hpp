@@ -0,0 +1,40 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "BarnesHut.hpp"
+#include "BodyState.hpp"
+
+namespace NB {
+// Axis-aligned rectangle [x0, x1) x [y0, y1) of the plane. A rank of a
+// distributed run owns one; empty() rectangles bound no bodies.
+struct Domain {
+    double x0 = 0.0, y0 = 0.0, x1 = -1.0, y1 = -1.0;
+
+    bool empty() const;
+    bool contains(double x, double y) const;
+    // Squared distance from (x, y) to the nearest point of the rectangle.
+    double distance2(double x, double y) const;
+};
+
+// Smallest rectangle holding every body of state; empty for no bodies.
+Domain boundingDomain(const BodyState& state);
+
+// Domain holding (x, y), or the nearest one when none does, for bodies
+// that have drifted out of the decomposed region.
+size_t owningDomain(const std::vector<Domain>& domains, double x, double y);
+
+struct PointMass {
+    double mass, x, y;
+};
+
+// The part of tree that bodies inside target need, as point masses: every
+// cell small enough, seen from the nearest point of target, to pass the
+// Barnes-Hut opening test as its monopole, and the leaves of the cells
+// that are not. Bodies in target then feel the tree's bodies as they
+// would through a walk of the tree itself. Appends to out.
+void essentialPoints(const QuadTree& tree, const Domain& target,
+                     double theta, std::vector<PointMass>* out);
+}  // namespace NB
@@ -0,0 +1,186 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include "DirectSum.hpp"
+using NB::BodyState;
+using NB::PairConstants;
+using NB::kDirectTile;
+
+static const double G = 6.67430e-11;
+
+// Adds the accelerations due to every pair (i, j) with i in [i0, i1) and
+// j in [j0, j1) to ax/ay, and with Potential their potential energy to
+// *potential. When the two ranges are the same tile only the pairs with
+// i < j are visited.
+template <bool Softened, bool Potential>
+static void directTile(const BodyState& state, size_t i0, size_t i1,
+                       size_t j0, size_t j1, const PairConstants& constants,
+                       double* ax, double* ay, double* potential) {
+    const double* x = state.x.data();
+    const double* y = state.y.data();
+    const double* m = state.mass.data();
+    const bool diagonal = i0 == j0;
+
+    for (size_t i = i0; i < i1; i++) {
+        const double xi = x[i];
+        const double yi = y[i];
+        const double gmi = G * m[i];
+        double axi = 0.0;
+        double ayi = 0.0;
+        double phi = 0.0;  // sum of m_j / r
+
+        for (size_t j = diagonal ? i + 1 : j0; j < j1; j++) {
+            double dx = x[j] - xi;
+            double dy = y[j] - yi;
+            double r2 = dx * dx + dy * dy;
+            if constexpr (Softened) {
+                r2 += constants.softening2;
+            }
+            double inv = 1.0 / (r2 * std::sqrt(r2));
+            double sj = G * m[j] * inv;
+            double si = gmi * inv;
+
+            axi += dx * sj;
+            ayi += dy * sj;
+            ax[j] -= dx * si;
+            ay[j] -= dy * si;
+            if constexpr (Potential) {
+                phi += m[j] * (inv * r2);
+            }
+        }
+
+        ax[i] += axi;
+        ay[i] += ayi;
+        if constexpr (Potential) {
+            *potential -= gmi * phi;
+        }
+    }
+}
+
+// The same in single precision. The j tile is first copied to float
+// buffers, relative to the tile's first body and in units of the scene
+// extent, so the inner loop touches only floats and vectorizes twice as
+// wide. Sums are returned to the double arrays once per tile.
+template <bool Softened, bool Potential>
+static void directTileFloat(const BodyState& state, size_t i0, size_t i1,
+                            size_t j0, size_t j1,
+                            const PairConstants& constants,
+                            double* ax, double* ay, double* potential) {
+    const double* x = state.x.data();
+    const double* y = state.y.data();
+    const double* m = state.mass.data();
+    const bool diagonal = i0 == j0;
+    const double invL = 1.0 / constants.extent;
+    const double g = G * invL * invL;  // turns the scaled kernel into m/s^2
+    const float soft = static_cast<float>(constants.softening2 * invL * invL);
+    const double ox = x[j0];
+    const double oy = y[j0];
+
+    alignas(64) float xj[kDirectTile], yj[kDirectTile], gmj[kDirectTile];
+    alignas(64) float axj[kDirectTile], ayj[kDirectTile];
+    const size_t count = j1 - j0;
+    for (size_t k = 0; k < count; k++) {
+        xj[k] = static_cast<float>((x[j0 + k] - ox) * invL);
+        yj[k] = static_cast<float>((y[j0 + k] - oy) * invL);
+        gmj[k] = static_cast<float>(g * m[j0 + k]);
+        axj[k] = 0.0f;
+        ayj[k] = 0.0f;
+    }
+
+    for (size_t i = i0; i < i1; i++) {
+        const float xi = static_cast<float>((x[i] - ox) * invL);
+        const float yi = static_cast<float>((y[i] - oy) * invL);
+        const float gmi = static_cast<float>(g * m[i]);
+        float axi = 0.0f;
+        float ayi = 0.0f;
+        float phi = 0.0f;  // sum of G m_j / r in scaled units
+
+        for (size_t k = diagonal ? i - i0 + 1 : 0; k < count; k++) {
+            float dx = xj[k] - xi;
+            float dy = yj[k] - yi;
+            float r2 = dx * dx + dy * dy;
+            if constexpr (Softened) {
+                r2 += soft;
+            }
+            float inv = 1.0f / (r2 * std::sqrt(r2));
+            float sj = gmj[k] * inv;
+            float si = gmi * inv;
+
+            axi += dx * sj;
+            ayi += dy * sj;
+            axj[k] -= dx * si;
+            ayj[k] -= dy * si;
+            if constexpr (Potential) {
+                phi += gmj[k] * (inv * r2);
+            }
+        }
+
+        ax[i] += axi;
+        ay[i] += ayi;
+        if constexpr (Potential) {
+            *potential -= m[i] * constants.extent * phi;
+        }
+    }
+
+    for (size_t k = 0; k < count; k++) {
+        ax[j0 + k] += axj[k];
+        ay[j0 + k] += ayj[k];
+    }
+}
+
+namespace NB {
+template <typename Real, bool Softened, bool Potential>
+void directTileRow(const BodyState& state, size_t row,
+                   const PairConstants& constants, double* ax, double* ay,
+                   double* potential) {
+    const size_t n = state.size();
+    const size_t i0 = row * kDirectTile;
+    const size_t i1 = std::min(n, i0 + kDirectTile);
+
+    for (size_t j0 = i0; j0 < n; j0 += kDirectTile) {
+        const size_t j1 = std::min(n, j0 + kDirectTile);
+        if constexpr (std::is_same_v<Real, float>) {
+            directTileFloat<Softened, Potential>(state, i0, i1, j0, j1,
+                                                 constants, ax, ay,
+                                                 potential);
+        } else {
+            directTile<Softened, Potential>(state, i0, i1, j0, j1, constants,
+                                            ax, ay, potential);
+        }
+    }
+}
+
+template void directTileRow<double, false, false>(
+    const BodyState&, size_t, const PairConstants&, double*, double*,
+    double*);
+template void directTileRow<double, false, true>(
+    const BodyState&, size_t, const PairConstants&, double*, double*,
+    double*);
+template void directTileRow<double, true, false>(
+    const BodyState&, size_t, const PairConstants&, double*, double*,
+    double*);
+template void directTileRow<double, true, true>(
+    const BodyState&, size_t, const PairConstants&, double*, double*,
+    double*);
+template void directTileRow<float, false, false>(
+    const BodyState&, size_t, const PairConstants&, double*, double*,
+    double*);
+template void directTileRow<float, false, true>(
+    const BodyState&, size_t, const PairConstants&, double*, double*,
+    double*);
+template void directTileRow<float, true, false>(
+    const BodyState&, size_t, const PairConstants&, double*, double*,
+    double*);
+template void directTileRow<float, true, true>(
+    const BodyState&, size_t, const PairConstants&, double*, double*,
+    double*);
+
+size_t directTileRows(size_t n) { return (n + kDirectTile - 1) / kDirectTile; }
+
+bool directRowInSlice(size_t row, size_t slice, size_t slices) {
+    size_t phase = row % (2 * slices);
+    return phase == slice || phase == 2 * slices - 1 - slice;
+}
+}  // namespace NB
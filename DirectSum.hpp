@@ -0,0 +1,48 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstddef>
+#include "BodyState.hpp"
+
+namespace NB {
+// Symmetric all-pairs gravity. Each pair is evaluated once and the equal
+// and opposite accelerations are scattered to both bodies, so a step costs
+// n(n-1)/2 square roots instead of n(n-1). softening2 is the square of the
+// Plummer softening length: pairs attract as G m / (r^2 + eps^2)^(3/2).
+
+// Bodies per tile; a tile's positions and masses stay resident in L1.
+constexpr size_t kDirectTile = 256;
+
+// Constants of one force evaluation.
+struct PairConstants {
+    double softening2 = 0.0;  // used by the Softened kernels only
+    double extent = 1.0;      // float kernels measure lengths in this unit
+};
+
+// The kernels are templates on the arithmetic type Real (double, or float
+// for fast previews) and on whether softening is applied, so each variant
+// is a branch-free loop; Universe picks the instantiation once per force
+// evaluation. Positions and the accumulators in ax/ay stay double; the
+// float kernels take coordinate differences in double, scale them by
+// 1 / extent so r^3 stays in range, and do the rest in float.
+
+// Adds the accelerations of every tile pair in tile row `row` (the tile
+// itself and every tile after it) to ax/ay. With Potential set it also adds
+// the potential energy of those pairs, -G m_i m_j / r each with r softened
+// like the force, to *potential; the 1 / r comes out of the force terms,
+// so this costs two operations per pair. Instantiated for double and
+// float, with and without softening and potential.
+template <typename Real, bool Softened, bool Potential = false>
+void directTileRow(const BodyState& state, size_t row,
+                   const PairConstants& constants, double* ax, double* ay,
+                   double* potential = nullptr);
+
+// Number of tile rows for n bodies.
+size_t directTileRows(size_t n);
+
+// Whether tile row `row` belongs to slice `slice` of `slices`.
+// Rows are dealt out back and forth so every slice gets a similar share of
+// the triangular pair space.
+bool directRowInSlice(size_t row, size_t slice, size_t slices);
+}  // namespace NB
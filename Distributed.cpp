@@ -0,0 +1,499 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <mpi.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "Distributed.hpp"
+using NB::BodyRecord;
+using NB::BodyState;
+using NB::DistributedUniverse;
+using NB::Domain;
+using NB::Integrator;
+using NB::SnapshotHeader;
+using NB::SnapshotInfo;
+using NB::SnapshotReader;
+
+static_assert(std::is_trivially_copyable_v<DistributedUniverse::Body>);
+static_assert(sizeof(Domain) == 4 * sizeof(double));
+static_assert(sizeof(NB::PointMass) == 3 * sizeof(double));
+
+// Halvings of the interval searched for an ORB cut; 48 take it to a
+// relative width of 1e-14.
+static const int kBisections = 48;
+
+DistributedUniverse::DistributedUniverse(MPI_Comm comm): _comm(comm) {
+    MPI_Comm_rank(comm, &_rank);
+    MPI_Comm_size(comm, &_ranks);
+    MPI_Type_contiguous(sizeof(Body), MPI_BYTE, &_bodyType);
+    MPI_Type_commit(&_bodyType);
+    MPI_Type_contiguous(3, MPI_DOUBLE, &_pointType);
+    MPI_Type_commit(&_pointType);
+}
+
+DistributedUniverse::~DistributedUniverse() {
+    MPI_Type_free(&_bodyType);
+    MPI_Type_free(&_pointType);
+}
+
+void DistributedUniverse::setTheta(double theta) { _theta = theta; }
+
+void DistributedUniverse::setSoftening(double softening) {
+    _softening2 = softening * softening;
+    _forcesCurrent = false;
+}
+
+bool DistributedUniverse::setIntegrator(Integrator integrator) {
+    if (integrator != Integrator::Euler &&
+        integrator != Integrator::Leapfrog) {
+        return false;
+    }
+    _integrator = integrator;
+    _forcesCurrent = false;
+    return true;
+}
+
+void DistributedUniverse::setImbalance(double imbalance) {
+    _imbalanceLimit = imbalance;
+    _rebalanceAt = 1.0 + imbalance;
+}
+
+void DistributedUniverse::setThreads(size_t threads) {
+    if (threads == 1) {
+        _pool.reset();
+    } else {
+        _pool = std::make_unique<ThreadPool>(threads);
+    }
+}
+
+int DistributedUniverse::rank() const { return _rank; }
+
+int DistributedUniverse::ranks() const { return _ranks; }
+
+size_t DistributedUniverse::localSize() const { return _bodies.size(); }
+
+const Domain& DistributedUniverse::domain() const { return _domain; }
+
+size_t DistributedUniverse::rebalances() const { return _rebalances; }
+
+double DistributedUniverse::imbalance() const { return _imbalance; }
+
+// Every rank reads only its slice of the mapped file, so only those pages
+// are loaded, and the first bisection sorts the bodies out spatially.
+void DistributedUniverse::load(const SnapshotReader& input) {
+    const uint64_t n = input.size();
+    const uint64_t begin = n * _rank / _ranks;
+    const uint64_t end = n * (_rank + 1) / _ranks;
+    _bodies.clear();
+    _bodies.reserve(end - begin);
+    BodyRecord record;
+    for (uint64_t i = begin; i < end; i++) {
+        input.body(i, &record);
+        _bodies.push_back({i, record.x, record.y, record.vx, record.vy, 0.0,
+                           0.0, record.mass, 1.0});
+    }
+
+    _forcesCurrent = false;
+    _rebalances = 0;
+    _rebalanceAt = 1.0 + _imbalanceLimit;
+    decompose();
+}
+
+// Rank 0 writes the header and the name table and every rank the image
+// indices of its input slice. The values go through a file view that puts
+// each of this rank's bodies at its id in each of the five arrays. The
+// file is on disk before it replaces path, as with writeSnapshot.
+bool DistributedUniverse::save(const std::string& path,
+                               const SnapshotReader& input,
+                               const SnapshotInfo& info,
+                               std::string* error) const {
+    auto everywhere = [&](bool ok) {
+        int local = ok, all = 0;
+        MPI_Allreduce(&local, &all, 1, MPI_INT, MPI_MIN, _comm);
+        return all != 0;
+    };
+    const std::string temporary = path + ".tmp";
+    MPI_File file;
+    if (!everywhere(MPI_File_open(_comm, temporary.c_str(),
+                                  MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                                  MPI_INFO_NULL, &file) == MPI_SUCCESS)) {
+        *error = "cannot create " + temporary;
+        return false;
+    }
+
+    const uint64_t n = input.size();
+    const SnapshotHeader header = NB::snapshotHeader(n, input.radius(),
+                                                     input.names(), info);
+    bool ok = MPI_File_set_size(file, header.arrayOffset
+                                + 5 * header.arrayStride) == MPI_SUCCESS;
+    auto write = [&](int status) { ok = ok && status == MPI_SUCCESS; };
+    if (_rank == 0) {
+        std::string names;
+        for (std::string_view name : input.names()) {
+            names.append(name);
+            names.push_back('\0');
+        }
+        write(MPI_File_write_at(file, 0, &header, sizeof(header), MPI_BYTE,
+                                MPI_STATUS_IGNORE));
+        write(MPI_File_write_at(file, header.namesOffset, names.data(),
+                                static_cast<int>(names.size()), MPI_BYTE,
+                                MPI_STATUS_IGNORE));
+    }
+
+    const uint64_t begin = n * _rank / _ranks;
+    const uint64_t end = n * (_rank + 1) / _ranks;
+    std::vector<uint32_t> images(end - begin);
+    for (uint64_t i = begin; i < end; i++) {
+        images[i - begin] = input.image(i);
+    }
+    write(MPI_File_write_at_all(file, header.imageOffset
+                                + begin * sizeof(uint32_t), images.data(),
+                                static_cast<int>(images.size()),
+                                MPI_UINT32_T, MPI_STATUS_IGNORE));
+
+    // A view's displacements must increase, so the bodies go in id order.
+    std::vector<const Body*> sorted(_bodies.size());
+    for (size_t j = 0; j < _bodies.size(); j++) {
+        sorted[j] = &_bodies[j];
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Body* a,
+                                               const Body* b) {
+        return a->id < b->id;
+    });
+    const size_t m = sorted.size();
+    std::vector<double> values(5 * m);
+    std::vector<MPI_Aint> places(5 * m);
+    for (size_t j = 0; j < m; j++) {
+        const Body& b = *sorted[j];
+        const double fields[5] = {b.x, b.y, b.vx, b.vy, b.mass};
+        for (size_t k = 0; k < 5; k++) {
+            values[k * m + j] = fields[k];
+            places[k * m + j] = static_cast<MPI_Aint>(
+                header.arrayOffset + k * header.arrayStride
+                + b.id * sizeof(double));
+        }
+    }
+    MPI_Datatype view;
+    MPI_Type_create_hindexed_block(static_cast<int>(5 * m), 1,
+                                   places.data(), MPI_DOUBLE, &view);
+    MPI_Type_commit(&view);
+    write(MPI_File_set_view(file, 0, MPI_DOUBLE, view, "native",
+                            MPI_INFO_NULL));
+    write(MPI_File_write_all(file, values.data(), static_cast<int>(5 * m),
+                             MPI_DOUBLE, MPI_STATUS_IGNORE));
+    MPI_Type_free(&view);
+    write(MPI_File_sync(file));
+    write(MPI_File_close(&file));
+
+    if (!everywhere(ok)) {
+        *error = "failed writing " + temporary;
+        if (_rank == 0) {
+            std::remove(temporary.c_str());
+        }
+        return false;
+    }
+    int renamed = 1;
+    if (_rank == 0) {
+        renamed = std::rename(temporary.c_str(), path.c_str()) == 0;
+        if (!renamed) {
+            std::remove(temporary.c_str());
+        } else {
+            renamed = NB::syncDirectory(path);
+        }
+    }
+    MPI_Bcast(&renamed, 1, MPI_INT, 0, _comm);
+    if (!renamed) {
+        *error = "cannot replace " + path;
+        return false;
+    }
+    return true;
+}
+
+void DistributedUniverse::gather(BodyState* state) const {
+    int n = static_cast<int>(_bodies.size());
+    std::vector<int> counts(_ranks), offsets(_ranks);
+    MPI_Gather(&n, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, _comm);
+    int total = 0;
+    for (int r = 0; r < _ranks; r++) {
+        offsets[r] = total;
+        total += counts[r];
+    }
+
+    std::vector<Body> all(_rank == 0 ? total : 0);
+    MPI_Gatherv(_bodies.data(), n, _bodyType, all.data(), counts.data(),
+                offsets.data(), _bodyType, 0, _comm);
+    state->clear();
+    if (_rank != 0) {
+        return;
+    }
+    std::sort(all.begin(), all.end(), [](const Body& a, const Body& b) {
+        return a.id < b.id;
+    });
+    state->resize(all.size());
+    for (size_t i = 0; i < all.size(); i++) {
+        state->x[i] = all[i].x;
+        state->y[i] = all[i].y;
+        state->vx[i] = all[i].vx;
+        state->vy[i] = all[i].vy;
+        state->ax[i] = all[i].ax;
+        state->ay[i] = all[i].ay;
+        state->mass[i] = all[i].mass;
+    }
+}
+
+void DistributedUniverse::step(double dt) {
+    if (_integrator == Integrator::Leapfrog) {
+        stepKickDrift<NB::LeapfrogPolicy>(dt);
+    } else {
+        stepKickDrift<NB::EulerPolicy>(dt);
+    }
+}
+
+// Universe::stepKickDrift on the local bodies, with a migration after the
+// drift so the closing force pass sees every body on its owner.
+template <typename Policy>
+void DistributedUniverse::stepKickDrift(double dt) {
+    if (!_forcesCurrent) {
+        computeForces();
+    }
+    const double kick = Policy::kOpen * dt;
+    for (Body& b : _bodies) {
+        b.vx += b.ax * kick;
+        b.vy += b.ay * kick;
+        b.x += b.vx * dt;
+        b.y += b.vy * dt;
+    }
+    migrate();
+    if constexpr (Policy::kClose != 0.0) {
+        computeForces();
+        const double close = Policy::kClose * dt;
+        for (Body& b : _bodies) {
+            b.vx += b.ax * close;
+            b.vy += b.ay * close;
+        }
+        _forcesCurrent = true;
+    } else {
+        _forcesCurrent = false;
+    }
+    if (_imbalance > _rebalanceAt) {
+        decompose();
+        _rebalanced = true;
+    }
+}
+
+void DistributedUniverse::computeForces() {
+    const size_t n = _bodies.size();
+    _local.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        _local.x[i] = _bodies[i].x;
+        _local.y[i] = _bodies[i].y;
+        _local.mass[i] = _bodies[i].mass;
+    }
+    _localTree.build(_local);
+
+    // Every rank learns where every other rank's bodies are and sends
+    // each one the essential part of its tree for that box.
+    Domain bounds = NB::boundingDomain(_local);
+    _bounds.resize(_ranks);
+    MPI_Allgather(&bounds, 4, MPI_DOUBLE, _bounds.data(), 4, MPI_DOUBLE,
+                  _comm);
+    std::vector<int> sendCounts(_ranks), sendOffsets(_ranks);
+    std::vector<int> receiveCounts(_ranks), receiveOffsets(_ranks);
+    _send.clear();
+    for (int r = 0; r < _ranks; r++) {
+        sendOffsets[r] = static_cast<int>(_send.size());
+        if (r != _rank) {
+            NB::essentialPoints(_localTree, _bounds[r], _theta, &_send);
+        }
+        sendCounts[r] = static_cast<int>(_send.size()) - sendOffsets[r];
+    }
+    MPI_Alltoall(sendCounts.data(), 1, MPI_INT, receiveCounts.data(), 1,
+                 MPI_INT, _comm);
+    int received = 0;
+    for (int r = 0; r < _ranks; r++) {
+        receiveOffsets[r] = received;
+        received += receiveCounts[r];
+    }
+    _receive.resize(received);
+    MPI_Alltoallv(_send.data(), sendCounts.data(), sendOffsets.data(),
+                  _pointType, _receive.data(), receiveCounts.data(),
+                  receiveOffsets.data(), _pointType, _comm);
+
+    _combined.resize(n + _receive.size());
+    for (size_t i = 0; i < n; i++) {
+        _combined.x[i] = _local.x[i];
+        _combined.y[i] = _local.y[i];
+        _combined.mass[i] = _local.mass[i];
+    }
+    for (size_t k = 0; k < _receive.size(); k++) {
+        _combined.x[n + k] = _receive[k].x;
+        _combined.y[n + k] = _receive[k].y;
+        _combined.mass[n + k] = _receive[k].mass;
+    }
+    _tree.build(_combined);
+
+    auto body = [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            Body& b = _bodies[i];
+            QuadTree::Walk walk = _tree.acceleration(
+                _combined, i, _theta, _softening2, &b.ax, &b.ay);
+            b.work = static_cast<double>(std::max<size_t>(walk.interactions,
+                                                          1));
+        }
+    };
+    if (_pool) {
+        _pool->parallelFor(0, n, 256, body);
+    } else {
+        body(0, n, 0);
+    }
+
+    double work = 0.0;
+    for (const Body& b : _bodies) {
+        work += b.work;
+    }
+    double most = 0.0, total = 0.0;
+    MPI_Allreduce(&work, &most, 1, MPI_DOUBLE, MPI_MAX, _comm);
+    MPI_Allreduce(&work, &total, 1, MPI_DOUBLE, MPI_SUM, _comm);
+    _imbalance = total > 0 ? most * _ranks / total : 1.0;
+    if (_rebalanced) {
+        _rebalanceAt = (1.0 + _imbalanceLimit) * std::max(1.0, _imbalance);
+        _rebalanced = false;
+    }
+}
+
+// Orthogonal recursive bisection. At every level the ranks of comm agree
+// on a cut by bisecting for the coordinate below which lies the left
+// half's share of the work, send each body across to a rank of its side,
+// and split comm in two.
+void DistributedUniverse::decompose() {
+    double local[4] = {-1e300, -1e300, -1e300, -1e300};  // -x0 -y0 x1 y1
+    for (const Body& b : _bodies) {
+        local[0] = std::max(local[0], -b.x);
+        local[1] = std::max(local[1], -b.y);
+        local[2] = std::max(local[2], b.x);
+        local[3] = std::max(local[3], b.y);
+    }
+    double global[4];
+    MPI_Allreduce(local, global, 4, MPI_DOUBLE, MPI_MAX, _comm);
+    Domain box{-global[0], -global[1], global[2], global[3]};
+    if (box.empty()) {
+        box = {0.0, 0.0, 1.0, 1.0};
+    }
+    // Pad the far edges so bodies on them fall strictly inside.
+    double span = std::max(box.x1 - box.x0, box.y1 - box.y0);
+    span = span > 0 ? span : 1.0;
+    box.x1 += span * 1e-6;
+    box.y1 += span * 1e-6;
+
+    MPI_Comm comm;
+    MPI_Comm_dup(_comm, &comm);
+    int size, me;
+    MPI_Comm_size(comm, &size);
+    std::vector<int> destination;
+    while (size > 1) {
+        MPI_Comm_rank(comm, &me);
+        const int left = size / 2;
+        const bool alongX = box.x1 - box.x0 >= box.y1 - box.y0;
+        auto coordinate = [alongX](const Body& b) {
+            return alongX ? b.x : b.y;
+        };
+        auto workBelow = [&](double cut) {
+            double below = 0.0, sum = 0.0;
+            for (const Body& b : _bodies) {
+                if (coordinate(b) < cut) {
+                    below += b.work;
+                }
+            }
+            MPI_Allreduce(&below, &sum, 1, MPI_DOUBLE, MPI_SUM, comm);
+            return sum;
+        };
+
+        double lo = alongX ? box.x0 : box.y0;
+        double hi = alongX ? box.x1 : box.y1;
+        const double target = workBelow(hi) * left / size;
+        for (int k = 0; k < kBisections; k++) {
+            double mid = (lo + hi) / 2;
+            if (workBelow(mid) < target) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        const double cut = (lo + hi) / 2;
+
+        destination.resize(_bodies.size());
+        for (size_t i = 0; i < _bodies.size(); i++) {
+            destination[i] = coordinate(_bodies[i]) < cut
+                ? me % left : left + me % (size - left);
+        }
+        exchange(comm, destination);
+
+        const bool isLeft = me < left;
+        double& edge = alongX ? (isLeft ? box.x1 : box.x0)
+                              : (isLeft ? box.y1 : box.y0);
+        edge = cut;
+        MPI_Comm half;
+        MPI_Comm_split(comm, isLeft ? 0 : 1, me, &half);
+        MPI_Comm_free(&comm);
+        comm = half;
+        MPI_Comm_size(comm, &size);
+    }
+    MPI_Comm_free(&comm);
+
+    _domain = box;
+    _domains.resize(_ranks);
+    MPI_Allgather(&_domain, 4, MPI_DOUBLE, _domains.data(), 4, MPI_DOUBLE,
+                  _comm);
+    _rebalances++;
+}
+
+// Bodies that drifted out of this rank's domain go to the domain they are
+// in now; the decomposition itself stays until the next rebalance.
+void DistributedUniverse::migrate() {
+    std::vector<int> destination(_bodies.size(), _rank);
+    for (size_t i = 0; i < _bodies.size(); i++) {
+        if (!_domain.contains(_bodies[i].x, _bodies[i].y)) {
+            destination[i] = static_cast<int>(
+                NB::owningDomain(_domains, _bodies[i].x, _bodies[i].y));
+        }
+    }
+    exchange(_comm, destination);
+}
+
+void DistributedUniverse::exchange(MPI_Comm comm,
+                                   const std::vector<int>& destination) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    std::vector<int> sendCounts(size, 0), sendOffsets(size);
+    std::vector<int> receiveCounts(size), receiveOffsets(size);
+    for (int d : destination) {
+        sendCounts[d]++;
+    }
+    int offset = 0;
+    for (int r = 0; r < size; r++) {
+        sendOffsets[r] = offset;
+        offset += sendCounts[r];
+    }
+    _outgoing.resize(_bodies.size());
+    std::vector<int> next = sendOffsets;
+    for (size_t i = 0; i < _bodies.size(); i++) {
+        _outgoing[next[destination[i]]++] = _bodies[i];
+    }
+
+    MPI_Alltoall(sendCounts.data(), 1, MPI_INT, receiveCounts.data(), 1,
+                 MPI_INT, comm);
+    int received = 0;
+    for (int r = 0; r < size; r++) {
+        receiveOffsets[r] = received;
+        received += receiveCounts[r];
+    }
+    _bodies.resize(received);
+    MPI_Alltoallv(_outgoing.data(), sendCounts.data(), sendOffsets.data(),
+                  _bodyType, _bodies.data(), receiveCounts.data(),
+                  receiveOffsets.data(), _bodyType, comm);
+}
@@ -0,0 +1,115 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <mpi.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BarnesHut.hpp"
+#include "BodyState.hpp"
+#include "Decomposition.hpp"
+#include "Integrator.hpp"
+#include "Snapshot.hpp"
+#include "ThreadPool.hpp"
+
+namespace NB {
+// A universe spread over the ranks of an MPI communicator, for runs that
+// outgrow one machine. Space is split by orthogonal recursive bisection:
+// the ranks are halved again and again, each time cutting the longer side
+// of the region at the point that gives each half its share of the work,
+// where a body's work is the number of force terms it summed last step.
+// Every rank steps only its own bodies. For the forces it sends each other
+// rank the essential part of its Barnes-Hut tree (see essentialPoints)
+// and walks a tree of its bodies plus what it received. Bodies that leave
+// their rank's region migrate after every step; when the busiest rank does
+// more than 1 + imbalance times the average work, the bisection is redone.
+// If a bisection cannot get below that (too few bodies, say), the next one
+// waits until the balance is 1 + imbalance times worse than it achieved.
+// Bodies are read from and written to snapshot files by every rank at
+// once, so no rank ever holds more than its share of them.
+//
+// Every member function is collective: all ranks call it together.
+class DistributedUniverse {
+ public:
+    // A body as it travels between ranks; id is its index in the input.
+    struct Body {
+        uint64_t id;
+        double x, y, vx, vy, ax, ay, mass;
+        double work;
+    };
+
+    explicit DistributedUniverse(MPI_Comm comm);
+    DistributedUniverse(const DistributedUniverse&) = delete;
+    DistributedUniverse& operator=(const DistributedUniverse&) = delete;
+    ~DistributedUniverse();
+
+    void setTheta(double theta);
+    void setSoftening(double softening);
+    // Euler and Leapfrog only; returns false for the other integrators.
+    bool setIntegrator(Integrator integrator);
+    void setImbalance(double imbalance);  // default 0.2
+    void setThreads(size_t threads);      // per rank; 0 for all cores
+
+    // Each rank takes bodies [n r / P, n (r + 1) / P) of input, its own
+    // mapping of the same snapshot, then the bodies are decomposed.
+    void load(const SnapshotReader& input);
+    void step(double dt);
+    // Writes every body, in input order, into one snapshot with collective
+    // MPI-IO; the image names and indices are input's. Replaces path only
+    // once every rank has written its part.
+    bool save(const std::string& path, const SnapshotReader& input,
+              const SnapshotInfo& info, std::string* error) const;
+    // Collects every body on rank 0 in input order; other ranks get none.
+    // For checks on inputs that fit on one rank.
+    void gather(BodyState* state) const;
+
+    int rank() const;
+    int ranks() const;
+    size_t localSize() const;
+    const Domain& domain() const;  // the region this rank owns
+    size_t rebalances() const;     // bisections since load()
+    // Busiest rank's work over the mean, from the last force pass.
+    double imbalance() const;
+
+ private:
+    template <typename Policy>
+    void stepKickDrift(double dt);
+    void computeForces();
+    void decompose();
+    void migrate();
+    // Sends every body to rank destination[i] of comm.
+    void exchange(MPI_Comm comm, const std::vector<int>& destination);
+
+    MPI_Comm _comm;
+    MPI_Datatype _bodyType;   // one Body
+    MPI_Datatype _pointType;  // one PointMass
+    int _rank = 0;
+    int _ranks = 1;
+    double _theta = 0.5;
+    double _softening2 = 0.0;
+    double _imbalanceLimit = 0.2;
+    Integrator _integrator = Integrator::Euler;
+    bool _forcesCurrent = false;
+    size_t _rebalances = 0;
+    double _imbalance = 1.0;
+    double _rebalanceAt = 1.2;  // imbalance that triggers a bisection
+    bool _rebalanced = false;   // set _rebalanceAt from the next pass
+
+    std::vector<Body> _bodies;
+    Domain _domain;
+    std::vector<Domain> _domains;  // every rank's, indexed by rank
+    std::unique_ptr<ThreadPool> _pool;
+
+    // Scratch reused from step to step.
+    std::vector<Body> _outgoing;  // bodies grouped by destination
+    std::vector<Domain> _bounds;  // every rank's bodies' bounding box
+    BodyState _local;     // own bodies, for the essential trees
+    BodyState _combined;  // own bodies then imported points
+    QuadTree _localTree;
+    QuadTree _tree;
+    std::vector<PointMass> _send, _receive;
+};
+}  // namespace NB
@@ -0,0 +1,296 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include "Ensemble.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NB_X86 1
+#endif
+
+using NB::BodyState;
+using NB::Ensemble;
+using NB::Integrator;
+using NB::SimdLevel;
+using NB::ThreadPool;
+
+static const double G = 6.67430e-11;
+
+// Standard normal draws for one member. seed_seq and the 64-bit engine
+// are both fixed by the standard, so a seed gives the same members with
+// any standard library.
+static std::mt19937_64 memberEngine(uint64_t seed, uint64_t member) {
+    std::seed_seq sequence{static_cast<uint32_t>(seed),
+                           static_cast<uint32_t>(seed >> 32),
+                           static_cast<uint32_t>(member),
+                           static_cast<uint32_t>(member >> 32)};
+    return std::mt19937_64(sequence);
+}
+
+static double normal(std::mt19937_64& engine) {  // Box-Muller
+    auto uniform = [&engine]() {  // (0, 1)
+        return (static_cast<double>(engine() >> 11) + 0.5) * 0x1p-53;
+    };
+    double r = std::sqrt(-2.0 * std::log(uniform()));
+    return r * std::cos(2.0 * M_PI * uniform());
+}
+
+namespace {
+constexpr size_t kLanes = Ensemble::kLanes;
+
+// Pairs i < j in the order of the direct tile kernel, each for all lanes.
+// Only correctly rounded operations are used, so the vector path gives
+// the same bits as this one.
+void scalarLanes(const double* x, const double* y, const double* mass,
+                 size_t n, double softening2, double* ax, double* ay) {
+    for (size_t i = 0; i < n; i++) {
+        const double* xi = x + i * kLanes;
+        const double* yi = y + i * kLanes;
+        const double gmi = G * mass[i];
+        double axi[kLanes] = {};
+        double ayi[kLanes] = {};
+
+        for (size_t j = i + 1; j < n; j++) {
+            const double* xj = x + j * kLanes;
+            const double* yj = y + j * kLanes;
+            double* axj = ax + j * kLanes;
+            double* ayj = ay + j * kLanes;
+            const double gmj = G * mass[j];
+            for (size_t l = 0; l < kLanes; l++) {
+                double dx = xj[l] - xi[l];
+                double dy = yj[l] - yi[l];
+                double r2 = dx * dx + dy * dy + softening2;
+                double inv = 1.0 / (r2 * std::sqrt(r2));
+                double sj = gmj * inv;
+                double si = gmi * inv;
+
+                axi[l] += dx * sj;
+                ayi[l] += dy * sj;
+                axj[l] -= dx * si;
+                ayj[l] -= dy * si;
+            }
+        }
+
+        for (size_t l = 0; l < kLanes; l++) {
+            ax[i * kLanes + l] += axi[l];
+            ay[i * kLanes + l] += ayi[l];
+        }
+    }
+}
+
+#ifdef NB_X86
+// scalarLanes with the eight lanes in two AVX registers. No fused
+// multiply-adds, which would change the rounding.
+__attribute__((target("avx2")))
+void avx2Lanes(const double* x, const double* y, const double* mass,
+               size_t n, double softening2, double* ax, double* ay) {
+    static_assert(kLanes == 8, "two registers of four lanes");
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d soft = _mm256_set1_pd(softening2);
+
+    for (size_t i = 0; i < n; i++) {
+        const double* xi = x + i * kLanes;
+        const double* yi = y + i * kLanes;
+        const __m256d gmi = _mm256_set1_pd(G * mass[i]);
+        __m256d axi[2], ayi[2], xiv[2], yiv[2];
+        for (int h = 0; h < 2; h++) {
+            axi[h] = _mm256_setzero_pd();
+            ayi[h] = _mm256_setzero_pd();
+            xiv[h] = _mm256_load_pd(xi + 4 * h);
+            yiv[h] = _mm256_load_pd(yi + 4 * h);
+        }
+
+        for (size_t j = i + 1; j < n; j++) {
+            const __m256d gmj = _mm256_set1_pd(G * mass[j]);
+            for (int h = 0; h < 2; h++) {
+                const size_t a = j * kLanes + 4 * h;
+                __m256d dx = _mm256_sub_pd(_mm256_load_pd(x + a), xiv[h]);
+                __m256d dy = _mm256_sub_pd(_mm256_load_pd(y + a), yiv[h]);
+                __m256d r2 = _mm256_add_pd(_mm256_add_pd(
+                    _mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), soft);
+                __m256d inv = _mm256_div_pd(one, _mm256_mul_pd(
+                    r2, _mm256_sqrt_pd(r2)));
+                __m256d sj = _mm256_mul_pd(gmj, inv);
+                __m256d si = _mm256_mul_pd(gmi, inv);
+
+                axi[h] = _mm256_add_pd(axi[h], _mm256_mul_pd(dx, sj));
+                ayi[h] = _mm256_add_pd(ayi[h], _mm256_mul_pd(dy, sj));
+                _mm256_store_pd(ax + a, _mm256_sub_pd(
+                    _mm256_load_pd(ax + a), _mm256_mul_pd(dx, si)));
+                _mm256_store_pd(ay + a, _mm256_sub_pd(
+                    _mm256_load_pd(ay + a), _mm256_mul_pd(dy, si)));
+            }
+        }
+
+        for (int h = 0; h < 2; h++) {
+            const size_t a = i * kLanes + 4 * h;
+            _mm256_store_pd(ax + a,
+                            _mm256_add_pd(_mm256_load_pd(ax + a), axi[h]));
+            _mm256_store_pd(ay + a,
+                            _mm256_add_pd(_mm256_load_pd(ay + a), ayi[h]));
+        }
+    }
+}
+#endif
+
+void laneForces(const double* x, const double* y, const double* mass,
+                size_t n, double softening2, SimdLevel level,
+                double* ax, double* ay) {
+#ifdef NB_X86
+    if (level != SimdLevel::Scalar) {
+        avx2Lanes(x, y, mass, n, softening2, ax, ay);
+        return;
+    }
+#endif
+    (void)level;
+    scalarLanes(x, y, mass, n, softening2, ax, ay);
+}
+}  // namespace
+
+void Ensemble::reset(const BodyState& base, size_t members, double spread,
+                     uint64_t seed) {
+    _members = members;
+    _bodies = base.size();
+    _blocks = (members + kLanes - 1) / kLanes;
+    _mass.assign(base.mass.begin(), base.mass.end());
+    const size_t total = _blocks * _bodies * kLanes;
+    for (auto* v : {&_x, &_y, &_vx, &_vy, &_ax, &_ay}) {
+        v->assign(total, 0.0);
+    }
+
+    // Lanes past the last member repeat member 0 and are never reported.
+    for (size_t k = 0; k < _blocks * kLanes; k++) {
+        const size_t block = k / kLanes;
+        const size_t lane = k % kLanes;
+        const bool perturbed = k > 0 && k < members && spread != 0.0;
+        std::mt19937_64 engine = memberEngine(seed, k);
+        auto jitter = [&](double value) {
+            return perturbed ? value * (1.0 + spread * normal(engine))
+                             : value;
+        };
+        for (size_t i = 0; i < _bodies; i++) {
+            const size_t a = at(block, i) + lane;
+            _x[a] = jitter(base.x[i]);
+            _y[a] = jitter(base.y[i]);
+            _vx[a] = jitter(base.vx[i]);
+            _vy[a] = jitter(base.vy[i]);
+        }
+    }
+    _level = NB::detectSimdLevel();
+    _forcesCurrent = false;
+}
+
+void Ensemble::setSoftening(double softening) {
+    _softening2 = softening * softening;
+    _forcesCurrent = false;
+}
+
+bool Ensemble::setIntegrator(Integrator integrator) {
+    if (integrator != Integrator::Euler &&
+        integrator != Integrator::Leapfrog) {
+        return false;
+    }
+    _integrator = integrator;
+    _forcesCurrent = false;
+    return true;
+}
+
+size_t Ensemble::members() const { return _members; }
+
+size_t Ensemble::bodies() const { return _bodies; }
+
+Integrator Ensemble::integrator() const { return _integrator; }
+
+size_t Ensemble::at(size_t block, size_t i) const {
+    return (block * _bodies + i) * kLanes;
+}
+
+void Ensemble::run(double dt, uint64_t steps, ThreadPool* pool) {
+    if (steps == 0 || _blocks == 0) {
+        return;
+    }
+    const bool leapfrog = _integrator == Integrator::Leapfrog;
+    auto body = [&](size_t begin, size_t end, size_t) {
+        for (size_t b = begin; b < end; b++) {
+            if (leapfrog) {
+                advance<NB::LeapfrogPolicy>(b, dt, steps);
+            } else {
+                advance<NB::EulerPolicy>(b, dt, steps);
+            }
+        }
+    };
+    if (pool) {
+        pool->parallelFor(0, _blocks, 1, body);
+    } else {
+        body(0, _blocks, 0);
+    }
+    _forcesCurrent = leapfrog;
+}
+
+void Ensemble::step(double dt, ThreadPool* pool) { run(dt, 1, pool); }
+
+void Ensemble::member(size_t k, BodyState* state) const {
+    state->resize(_bodies);
+    const size_t block = k / kLanes;
+    const size_t lane = k % kLanes;
+    for (size_t i = 0; i < _bodies; i++) {
+        const size_t a = at(block, i) + lane;
+        state->x[i] = _x[a];
+        state->y[i] = _y[a];
+        state->vx[i] = _vx[a];
+        state->vy[i] = _vy[a];
+        state->ax[i] = _ax[a];
+        state->ay[i] = _ay[a];
+        state->mass[i] = _mass[i];
+    }
+}
+
+// The steps of Universe::stepKickDrift, for the members of one block.
+template <typename Policy>
+void Ensemble::advance(size_t block, double dt, uint64_t steps) {
+    const size_t count = _bodies * kLanes;
+    double* x = &_x[at(block, 0)];
+    double* y = &_y[at(block, 0)];
+    double* vx = &_vx[at(block, 0)];
+    double* vy = &_vy[at(block, 0)];
+    const double* ax = &_ax[at(block, 0)];
+    const double* ay = &_ay[at(block, 0)];
+    bool current = _forcesCurrent;
+
+    for (uint64_t s = 0; s < steps; s++) {
+        if (!current) {
+            forces(block);
+        }
+        const double kick = Policy::kOpen * dt;
+        for (size_t a = 0; a < count; a++) {
+            vx[a] += ax[a] * kick;
+            vy[a] += ay[a] * kick;
+            x[a] += vx[a] * dt;
+            y[a] += vy[a] * dt;
+        }
+        if constexpr (Policy::kClose != 0.0) {
+            forces(block);
+            const double close = Policy::kClose * dt;
+            for (size_t a = 0; a < count; a++) {
+                vx[a] += ax[a] * close;
+                vy[a] += ay[a] * close;
+            }
+            current = true;
+        } else {
+            current = false;
+        }
+    }
+}
+
+void Ensemble::forces(size_t block) {
+    const size_t n = _bodies;
+    double* ax = &_ax[at(block, 0)];
+    double* ay = &_ay[at(block, 0)];
+    std::fill(ax, ax + n * kLanes, 0.0);
+    std::fill(ay, ay + n * kLanes, 0.0);
+    laneForces(&_x[at(block, 0)], &_y[at(block, 0)], _mass.data(), n,
+               _softening2, _level, ax, ay);
+}
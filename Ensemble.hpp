@@ -0,0 +1,66 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "BodyState.hpp"
+#include "Integrator.hpp"
+#include "SimdKernel.hpp"
+#include "ThreadPool.hpp"
+
+namespace NB {
+// Many independent copies of one small universe, stepped together. The
+// members are grouped into blocks of kLanes, and a block stores each
+// coordinate of a body for all its members side by side, so the pair
+// kernel runs the same pair for kLanes members at once in vector lanes
+// (two AVX2 registers, where the CPU has them). Blocks never interact: a
+// run hands whole blocks to the pool, and every block takes all its steps
+// without waiting for the others.
+//
+// The kernel sums pairs in the order of Universe's direct solver, so
+// member 0, which is never perturbed, follows a Universe of up to
+// kDirectTile bodies bit for bit.
+class Ensemble {
+ public:
+    static constexpr size_t kLanes = 8;
+
+    // Replaces the members with copies of base. Members 1 and up have each
+    // position and velocity component multiplied by 1 + spread * z, z a
+    // standard normal draw; a member's draws depend only on seed and its
+    // index.
+    void reset(const BodyState& base, size_t members, double spread,
+               uint64_t seed);
+    void setSoftening(double softening);
+    // Euler and Leapfrog only; returns false for the other integrators.
+    bool setIntegrator(Integrator integrator);
+
+    size_t members() const;
+    size_t bodies() const;
+    Integrator integrator() const;
+
+    void run(double dt, uint64_t steps, ThreadPool* pool);
+    void step(double dt, ThreadPool* pool);
+
+    // Copies member k into state, which is resized to bodies().
+    void member(size_t k, BodyState* state) const;
+
+ private:
+    // Offset of body i of block b in the interleaved arrays.
+    size_t at(size_t block, size_t i) const;
+    template <typename Policy>
+    void advance(size_t block, double dt, uint64_t steps);
+    void forces(size_t block);
+
+    size_t _members = 0;
+    size_t _bodies = 0;
+    size_t _blocks = 0;
+    double _softening2 = 0.0;
+    Integrator _integrator = Integrator::Euler;
+    bool _forcesCurrent = false;
+    SimdLevel _level = SimdLevel::Scalar;
+    std::vector<double> _mass;  // per body, shared by every member
+    AlignedVector<double> _x, _y, _vx, _vy, _ax, _ay;  // see at()
+};
+}  // namespace NB
@@ -0,0 +1,494 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+#include "FastMultipole.hpp"
+using NB::BodyState;
+using NB::FastMultipole;
+
+static const double G = 6.67430e-11;
+
+// Position of s^k conj(s)^l among the terms, which are ordered by total
+// degree k + l and then by l.
+static inline int term(int k, int l) {
+    return (k + l) * (k + l + 1) / 2 + l;
+}
+
+void FastMultipole::setOrder(int order) {
+    _order = std::clamp(order, 1, kMaxOrder);
+}
+
+void FastMultipole::setLeafSize(size_t bodies) {
+    _leafSize = std::max<size_t>(bodies, 1);
+}
+
+int FastMultipole::order() const { return _order; }
+
+const std::vector<FastMultipole::Cell>& FastMultipole::cells() const {
+    return _cells;
+}
+
+size_t FastMultipole::terms() const {
+    return static_cast<size_t>((_order + 1) * (_order + 2) / 2);
+}
+
+// Tables that only depend on the order, rebuilt when it changes.
+void FastMultipole::prepare() {
+    if (_preparedOrder == _order) {
+        return;
+    }
+    const int p = _order;
+    const size_t t = terms();
+    _termK.clear();
+    _termL.clear();
+    for (int n = 0; n <= p; n++) {
+        for (int l = 0; l <= n; l++) {
+            _termK.push_back(n - l);
+            _termL.push_back(l);
+        }
+    }
+    _sum.assign(t * t, -1);
+    _translationCost = 0;
+    for (size_t a = 0; a < t; a++) {
+        for (size_t b = 0; b < t; b++) {
+            int k = _termK[a] + _termK[b];
+            int l = _termL[a] + _termL[b];
+            if (k + l <= p) {
+                _sum[a * t + b] = term(k, l);
+                _translationCost++;
+            }
+        }
+    }
+
+    // w^(-1/2) and conj(w)^(-3/2) differentiated k times pick up the
+    // falling products (-1/2)(-3/2)... and (-3/2)(-5/2)...
+    _invFact.assign(p + 1, 1.0);
+    _holo.assign(p + 1, 1.0);
+    _anti.assign(p + 1, 1.0);
+    for (int k = 1; k <= p; k++) {
+        _invFact[k] = _invFact[k - 1] / k;
+        _holo[k] = _holo[k - 1] * (-0.5 - (k - 1));
+        _anti[k] = _anti[k - 1] * (-1.5 - (k - 1));
+    }
+    _kernel.assign(t, 0.0);
+    _pow.assign(p + 1, 0.0);
+    _preparedOrder = p;
+}
+
+FastMultipole::Walk FastMultipole::evaluate(BodyState& state, double theta,
+                                            double softening2) {
+    Walk walk;
+    const size_t n = state.size();
+    if (n == 0) {
+        return walk;
+    }
+
+    prepare();
+    build(state);
+    _soft2 = softening2 / (_scale * _scale);
+    upward();
+    if (_soft2 > 0) {
+        interact<true>(theta, &walk);
+    } else {
+        interact<false>(theta, &walk);
+    }
+    downward();
+
+    const double s = G / (_scale * _scale);
+    for (size_t k = 0; k < n; k++) {
+        const uint32_t i = _sorted[k];
+        state.ax[i] = s * _ax[k];
+        state.ay[i] = s * _ay[k];
+    }
+    return walk;
+}
+
+// Splits cells breadth first, partitioning each cell's bodies into its
+// quadrants in place, so every cell's bodies, and those of all its
+// descendants, form one range of _sorted.
+void FastMultipole::build(const BodyState& state) {
+    const size_t n = state.size();
+    double minX = state.x[0], maxX = state.x[0];
+    double minY = state.y[0], maxY = state.y[0];
+    for (size_t i = 1; i < n; i++) {
+        minX = std::min(minX, state.x[i]);
+        maxX = std::max(maxX, state.x[i]);
+        minY = std::min(minY, state.y[i]);
+        maxY = std::max(maxY, state.y[i]);
+    }
+    const double ox = (minX + maxX) / 2;
+    const double oy = (minY + maxY) / 2;
+    double half = std::max(maxX - minX, maxY - minY) / 2;
+    _scale = half > 0 ? half * (1 + 1e-6) : 1.0;
+
+    _px.resize(n);
+    _py.resize(n);
+    _pm.resize(n);
+    _scratch.resize(n);
+    _sorted.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        _sorted[i] = static_cast<uint32_t>(i);
+    }
+    // Scaled positions in body order for now; gathered into cell order
+    // once the tree is built.
+    for (size_t i = 0; i < n; i++) {
+        _px[i] = (state.x[i] - ox) / _scale;
+        _py[i] = (state.y[i] - oy) / _scale;
+    }
+
+    _cells.clear();
+    Cell root{};
+    root.half = 1.0;
+    root.child = -1;
+    root.end = static_cast<int>(n);
+    _cells.push_back(root);
+
+    for (size_t c = 0; c < _cells.size(); c++) {
+        const Cell cell = _cells[c];
+        if (static_cast<size_t>(cell.end - cell.begin) <= _leafSize ||
+            cell.depth >= kMaxDepth) {
+            continue;
+        }
+
+        auto quadrant = [&](uint32_t i) {
+            return (_px[i] >= cell.sx ? 1 : 0) + (_py[i] >= cell.sy ? 2 : 0);
+        };
+        int count[4] = {0, 0, 0, 0};
+        for (int k = cell.begin; k < cell.end; k++) {
+            count[quadrant(_sorted[k])]++;
+        }
+        int offset[4];
+        offset[0] = cell.begin;
+        for (int q = 1; q < 4; q++) {
+            offset[q] = offset[q - 1] + count[q - 1];
+        }
+        for (int k = cell.begin; k < cell.end; k++) {
+            _scratch[offset[quadrant(_sorted[k])]++] = _sorted[k];
+        }
+        std::copy(_scratch.begin() + cell.begin, _scratch.begin() + cell.end,
+                  _sorted.begin() + cell.begin);
+
+        const int first = static_cast<int>(_cells.size());
+        const double h = cell.half / 2;
+        int start = cell.begin;
+        for (int q = 0; q < 4; q++) {
+            if (count[q] == 0) {
+                continue;
+            }
+            Cell child{};
+            child.sx = cell.sx + ((q & 1) ? h : -h);
+            child.sy = cell.sy + ((q & 2) ? h : -h);
+            child.half = h;
+            child.child = -1;
+            child.begin = start;
+            child.end = start + count[q];
+            child.depth = cell.depth + 1;
+            _cells.push_back(child);
+            start += count[q];
+        }
+        _cells[c].child = first;
+        _cells[c].children = static_cast<int>(_cells.size()) - first;
+    }
+
+    // Gather into cell order through the acceleration buffers, which are
+    // not needed until the walk.
+    _ax.resize(n);
+    _ay.resize(n);
+    for (size_t k = 0; k < n; k++) {
+        const uint32_t i = _sorted[k];
+        _ax[k] = _px[i];
+        _ay[k] = _py[i];
+        _pm[k] = state.mass[i];
+    }
+    _px.swap(_ax);
+    _py.swap(_ay);
+}
+
+// Children come after their parents, so a reverse sweep forms every
+// child's moments before its parent gathers them (P2M, then M2M).
+void FastMultipole::upward() {
+    const size_t t = terms();
+    const int p = _order;
+    _multipole.assign(_cells.size() * t, 0.0);
+
+    for (size_t c = _cells.size(); c-- > 0;) {
+        Cell& cell = _cells[c];
+        Complex* m = &_multipole[c * t];
+        double mass = 0.0, mx = 0.0, my = 0.0;
+
+        if (cell.child < 0) {
+            for (int k = cell.begin; k < cell.end; k++) {
+                mass += _pm[k];
+                mx += _pm[k] * _px[k];
+                my += _pm[k] * _py[k];
+            }
+            cell.mass = mass;
+            cell.cx = mass > 0 ? mx / mass : cell.sx;
+            cell.cy = mass > 0 ? my / mass : cell.sy;
+            cell.radius = 0.0;
+            for (int k = cell.begin; k < cell.end; k++) {
+                const Complex s(_px[k] - cell.cx, _py[k] - cell.cy);
+                cell.radius = std::max(cell.radius, std::abs(s));
+                _pow[0] = 1.0;
+                for (int j = 1; j <= p; j++) {
+                    _pow[j] = _pow[j - 1] * s;
+                }
+                for (size_t tt = 0; tt < t; tt++) {
+                    const int a = _termK[tt];
+                    const int b = _termL[tt];
+                    m[tt] += _pm[k] * _invFact[a] * _invFact[b]
+                           * _pow[a] * std::conj(_pow[b]);
+                }
+            }
+            continue;
+        }
+
+        const int last = cell.child + cell.children;
+        for (int ch = cell.child; ch < last; ch++) {
+            mass += _cells[ch].mass;
+            mx += _cells[ch].mass * _cells[ch].cx;
+            my += _cells[ch].mass * _cells[ch].cy;
+        }
+        cell.mass = mass;
+        cell.cx = mass > 0 ? mx / mass : cell.sx;
+        cell.cy = mass > 0 ? my / mass : cell.sy;
+        cell.radius = 0.0;
+        for (int ch = cell.child; ch < last; ch++) {
+            const Cell& child = _cells[ch];
+            const Complex d(child.cx - cell.cx, child.cy - cell.cy);
+            cell.radius = std::max(cell.radius, std::abs(d) + child.radius);
+
+            // Shifting the center by d: (s + d)^k / k! expands binomially.
+            _pow[0] = 1.0;
+            for (int j = 1; j <= p; j++) {
+                _pow[j] = _pow[j - 1] * d / static_cast<double>(j);
+            }
+            const Complex* mc = &_multipole[ch * t];
+            for (size_t tt = 0; tt < t; tt++) {
+                const int k = _termK[tt];
+                const int l = _termL[tt];
+                Complex sum = 0.0;
+                for (int a = 0; a <= k; a++) {
+                    for (int b = 0; b <= l; b++) {
+                        sum += mc[term(k - a, l - b)]
+                             * _pow[a] * std::conj(_pow[b]);
+                    }
+                }
+                m[tt] += sum;
+            }
+        }
+    }
+}
+
+// Dual tree walk from (root, root). A cell paired with itself splits into
+// its child pairs; well-separated pairs translate both ways, or are summed
+// directly when that is cheaper; anything else opens the larger cell.
+// Every pair of bodies is covered exactly once.
+template <bool Softened>
+void FastMultipole::interact(double theta, Walk* walk) {
+    const size_t t = terms();
+    _local.assign(_cells.size() * t, 0.0);
+    std::fill(_ax.begin(), _ax.end(), 0.0);
+    std::fill(_ay.begin(), _ay.end(), 0.0);
+
+    const double theta2 = theta * theta;
+    _stack.clear();
+    _stack.emplace_back(0, 0);
+    while (!_stack.empty()) {
+        const auto [a, b] = _stack.back();
+        _stack.pop_back();
+        walk->cellPairs++;
+        const Cell& A = _cells[a];
+        const Cell& B = _cells[b];
+
+        if (a == b) {
+            if (A.child < 0) {
+                directSelf<Softened>(a, walk);
+                continue;
+            }
+            for (int i = 0; i < A.children; i++) {
+                for (int j = i; j < A.children; j++) {
+                    _stack.emplace_back(A.child + i, A.child + j);
+                }
+            }
+            continue;
+        }
+
+        const double dx = A.cx - B.cx;
+        const double dy = A.cy - B.cy;
+        const double reach = A.radius + B.radius;
+        if (reach * reach < theta2 * (dx * dx + dy * dy)) {
+            const size_t pairs = static_cast<size_t>(A.end - A.begin)
+                               * static_cast<size_t>(B.end - B.begin);
+            if (pairs <= _translationCost) {
+                direct<Softened>(a, b, walk);
+            } else {
+                translate(a, b, walk);
+                translate(b, a, walk);
+            }
+            continue;
+        }
+
+        if (A.child < 0 && B.child < 0) {
+            direct<Softened>(a, b, walk);
+        } else if (B.child < 0 || (A.child >= 0 && A.radius >= B.radius)) {
+            for (int i = 0; i < A.children; i++) {
+                _stack.emplace_back(A.child + i, b);
+            }
+        } else {
+            for (int j = 0; j < B.children; j++) {
+                _stack.emplace_back(a, B.child + j);
+            }
+        }
+    }
+}
+
+// M2L. With D the offset between the centers, s and t the offsets of a
+// source and a target from theirs, the kernel at D + s - t is the double
+// Taylor series of its derivatives at D, which split into the source's
+// moments and powers of -t.
+void FastMultipole::translate(int source, int target, Walk* walk) {
+    const size_t t = terms();
+    const int p = _order;
+    const Cell& from = _cells[source];
+    const Cell& to = _cells[target];
+    const Complex d(from.cx - to.cx, from.cy - to.cy);
+    const double r2 = std::norm(d);
+    const Complex base = d / (r2 * std::sqrt(r2));
+    const Complex inv = 1.0 / d;
+
+    _pow[0] = 1.0;
+    for (int j = 1; j <= p; j++) {
+        _pow[j] = _pow[j - 1] * inv;
+    }
+    for (size_t tt = 0; tt < t; tt++) {
+        const int k = _termK[tt];
+        const int l = _termL[tt];
+        _kernel[tt] = _holo[k] * _anti[l] * base
+                    * _pow[k] * std::conj(_pow[l]);
+    }
+
+    const Complex* m = &_multipole[source * t];
+    Complex* local = &_local[target * t];
+    for (size_t b = 0; b < t; b++) {
+        const int* row = &_sum[b * t];
+        Complex sum = 0.0;
+        // Terms are ordered by degree, so the valid ones form a prefix.
+        for (size_t a = 0; a < t && row[a] >= 0; a++) {
+            sum += _kernel[row[a]] * m[a];
+        }
+        local[b] += sum;
+    }
+    walk->translations++;
+}
+
+template <bool Softened>
+void FastMultipole::direct(int a, int b, Walk* walk) {
+    const Cell& A = _cells[a];
+    const Cell& B = _cells[b];
+    for (int i = A.begin; i < A.end; i++) {
+        double axi = 0.0, ayi = 0.0;
+        for (int j = B.begin; j < B.end; j++) {
+            double dx = _px[j] - _px[i];
+            double dy = _py[j] - _py[i];
+            double r2 = dx * dx + dy * dy;
+            if constexpr (Softened) {
+                r2 += _soft2;
+            }
+            if (r2 > 0) {
+                double s = 1.0 / (r2 * std::sqrt(r2));
+                axi += dx * s * _pm[j];
+                ayi += dy * s * _pm[j];
+                _ax[j] -= dx * s * _pm[i];
+                _ay[j] -= dy * s * _pm[i];
+            }
+        }
+        _ax[i] += axi;
+        _ay[i] += ayi;
+    }
+    walk->interactions += 2 * static_cast<size_t>(A.end - A.begin)
+                        * static_cast<size_t>(B.end - B.begin);
+}
+
+template <bool Softened>
+void FastMultipole::directSelf(int a, Walk* walk) {
+    const Cell& A = _cells[a];
+    for (int i = A.begin; i < A.end; i++) {
+        double axi = 0.0, ayi = 0.0;
+        for (int j = i + 1; j < A.end; j++) {
+            double dx = _px[j] - _px[i];
+            double dy = _py[j] - _py[i];
+            double r2 = dx * dx + dy * dy;
+            if constexpr (Softened) {
+                r2 += _soft2;
+            }
+            if (r2 > 0) {
+                double s = 1.0 / (r2 * std::sqrt(r2));
+                axi += dx * s * _pm[j];
+                ayi += dy * s * _pm[j];
+                _ax[j] -= dx * s * _pm[i];
+                _ay[j] -= dy * s * _pm[i];
+            }
+        }
+        _ax[i] += axi;
+        _ay[i] += ayi;
+    }
+    const size_t count = A.end - A.begin;
+    walk->interactions += count * (count - 1);
+}
+
+// Parents come before their children: each local expansion is shifted
+// into the children (L2L) and, at the leaves, evaluated at the bodies
+// (L2P).
+void FastMultipole::downward() {
+    const size_t t = terms();
+    const int p = _order;
+    for (size_t c = 0; c < _cells.size(); c++) {
+        const Cell& cell = _cells[c];
+        const Complex* local = &_local[c * t];
+
+        if (cell.child < 0) {
+            for (int k = cell.begin; k < cell.end; k++) {
+                const Complex mt(cell.cx - _px[k], cell.cy - _py[k]);
+                _pow[0] = 1.0;
+                for (int j = 1; j <= p; j++) {
+                    _pow[j] = _pow[j - 1] * mt / static_cast<double>(j);
+                }
+                Complex acc = 0.0;
+                for (size_t tt = 0; tt < t; tt++) {
+                    acc += local[tt] * _pow[_termK[tt]]
+                         * std::conj(_pow[_termL[tt]]);
+                }
+                _ax[k] += acc.real();
+                _ay[k] += acc.imag();
+            }
+            continue;
+        }
+
+        for (int ch = cell.child; ch < cell.child + cell.children; ch++) {
+            const Cell& child = _cells[ch];
+            // The child's -t is the parent's -t minus the shift e.
+            const Complex me(cell.cx - child.cx, cell.cy - child.cy);
+            _pow[0] = 1.0;
+            for (int j = 1; j <= p; j++) {
+                _pow[j] = _pow[j - 1] * me / static_cast<double>(j);
+            }
+            Complex* out = &_local[ch * t];
+            for (size_t tt = 0; tt < t; tt++) {
+                const int k = _termK[tt];
+                const int l = _termL[tt];
+                const int left = p - k - l;
+                Complex sum = 0.0;
+                for (int a = 0; a <= left; a++) {
+                    for (int b = 0; a + b <= left; b++) {
+                        sum += local[term(k + a, l + b)]
+                             * _pow[a] * std::conj(_pow[b]);
+                    }
+                }
+                out[tt] += sum;
+            }
+        }
+    }
+}
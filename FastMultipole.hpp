@@ -0,0 +1,102 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "BodyState.hpp"
+
+namespace NB {
+// Fast multipole method for the gravity kernel. In complex form the pull
+// of a body at offset w is w / |w|^3 = w^(-1/2) conj(w)^(-3/2), a product
+// of a holomorphic and an antiholomorphic power, so it expands in the
+// monomials s^k conj(s)^l. Cells of an adaptive quadtree hold multipole
+// moments up to total degree p about their centre of mass. A dual tree
+// walk turns every well-separated pair of cells into two multipole-to-
+// local translations and everything else into direct sums, which makes a
+// step O(N) for a fixed order. A higher order or a smaller opening angle
+// buys accuracy with time.
+class FastMultipole {
+ public:
+    using Complex = std::complex<double>;
+
+    static constexpr int kMaxOrder = 24;
+    static constexpr int kMaxDepth = 40;
+
+    // Positions are stored scaled to the root cell, which keeps powers of
+    // high degree inside the range of a double.
+    struct Cell {
+        double sx, sy, half;  // square cell: center and half width
+        double cx, cy;        // expansion center: the center of mass
+        double radius;        // distance from (cx, cy) to the farthest body
+        double mass;
+        int child;     // first child, -1 for a leaf
+        int children;  // non-empty children, stored contiguously
+        int begin, end;  // the cell's bodies in the sorted order
+        int depth;
+    };
+
+    // Work done by one evaluate() call.
+    struct Walk {
+        size_t cellPairs = 0;     // pairs of cells examined
+        size_t translations = 0;  // multipole-to-local translations
+        size_t interactions = 0;  // body-body force terms
+    };
+
+    void setOrder(int order);  // clamped to 1..kMaxOrder, default 8
+    void setLeafSize(size_t bodies);  // bodies per leaf, default 32
+    int order() const;
+
+    // Sets ax/ay of every body. Cells whose radii sum to less than theta
+    // times the distance between their centers interact through their
+    // expansions. softening2 is the squared Plummer softening length; it
+    // applies to the direct sums, well-separated cells being far enough
+    // apart for it not to matter.
+    Walk evaluate(BodyState& state, double theta, double softening2);
+
+    const std::vector<Cell>& cells() const;
+
+ private:
+    size_t terms() const;
+    void prepare();
+    void build(const BodyState& state);
+    void upward();
+    template <bool Softened>
+    void interact(double theta, Walk* walk);
+    void downward();
+    void translate(int source, int target, Walk* walk);
+    template <bool Softened>
+    void direct(int a, int b, Walk* walk);
+    template <bool Softened>
+    void directSelf(int a, Walk* walk);
+
+    int _order = 8;
+    size_t _leafSize = 32;
+    int _preparedOrder = 0;
+    double _scale = 1.0;  // root half width; positions are divided by it
+    double _soft2 = 0.0;  // softening2 in scaled units
+
+    std::vector<Cell> _cells;
+    std::vector<uint32_t> _sorted;   // body indices, grouped by cell
+    std::vector<uint32_t> _scratch;  // partitioning buffer
+    std::vector<double> _px, _py, _pm;  // bodies in sorted order
+    std::vector<double> _ax, _ay;       // their accelerations
+    std::vector<Complex> _multipole;  // terms() moments per cell
+    std::vector<Complex> _local;      // terms() local coefficients per cell
+    std::vector<std::pair<int, int>> _stack;
+
+    // Term t is the monomial s^_termK[t] conj(s)^_termL[t], ordered by
+    // total degree. _sum[t1 * terms() + t2] is the term of their product,
+    // -1 past the order.
+    std::vector<int> _termK, _termL;
+    std::vector<int> _sum;
+    size_t _translationCost = 0;  // multiply-adds in one translation
+    std::vector<double> _invFact;
+    std::vector<double> _holo, _anti;  // d^k/dw^k w^(-1/2) and conj part
+    std::vector<Complex> _kernel;      // kernel derivatives for one pair
+    std::vector<Complex> _pow;         // powers of one offset
+};
+}  // namespace NB
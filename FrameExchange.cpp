@@ -0,0 +1,69 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include "FrameExchange.hpp"
+#include "Profiler.hpp"
+using NB::BodyState;
+using NB::FrameExchange;
+
+FrameExchange::Frame& FrameExchange::back() { return _frames[_back]; }
+
+// Release on the exchange makes the frame's contents visible to the
+// reader that acquires it.
+void FrameExchange::publish() {
+    _frames[_back].stamp = Profiler::now();
+    unsigned old = _middle.exchange(_back | kFresh,
+                                    std::memory_order_acq_rel);
+    _back = old & ~kFresh;
+    _published.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t FrameExchange::published() const {
+    return _published.load(std::memory_order_relaxed);
+}
+
+bool FrameExchange::acquire() {
+    if (!(_middle.load(std::memory_order_acquire) & kFresh)) {
+        return false;
+    }
+    unsigned fresh = _middle.exchange(_previous, std::memory_order_acq_rel);
+    _previous = _latest;
+    _latest = fresh & ~kFresh;
+    return true;
+}
+
+const FrameExchange::Frame& FrameExchange::latest() const {
+    return _frames[_latest];
+}
+
+const FrameExchange::Frame& FrameExchange::previous() const {
+    return _frames[_previous];
+}
+
+double FrameExchange::blend(uint64_t now, BodyState* out) const {
+    const Frame& b = latest();
+    const Frame& a = previous();
+    const size_t n = b.x.size();
+    out->resize(n);
+
+    // Until two frames of the same size have arrived there is nothing to
+    // interpolate from.
+    double alpha = 1.0;
+    if (a.x.size() == n && b.stamp > a.stamp) {
+        alpha = static_cast<double>(now > b.stamp ? now - b.stamp : 0)
+              / static_cast<double>(b.stamp - a.stamp);
+        alpha = std::min(alpha, 1.0);
+    }
+    if (alpha >= 1.0) {
+        std::copy(b.x.begin(), b.x.end(), out->x.begin());
+        std::copy(b.y.begin(), b.y.end(), out->y.begin());
+        return b.time;
+    }
+    for (size_t i = 0; i < n; i++) {
+        out->x[i] = a.x[i] + alpha * (b.x[i] - a.x[i]);
+        out->y[i] = a.y[i] + alpha * (b.y[i] - a.y[i]);
+    }
+    return a.time + alpha * (b.time - a.time);
+}
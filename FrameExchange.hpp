@@ -0,0 +1,57 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "BodyState.hpp"
+
+namespace NB {
+// Hands position snapshots from the simulation thread to the render thread
+// without locks. It is a triple buffer with one more buffer on the reader's
+// side: the writer fills back() and publishes it with a single atomic
+// exchange; the reader swaps in the newest published frame with another
+// and keeps the one before it for interpolation. Neither side ever waits,
+// frames the reader misses are simply overwritten, and once the buffers
+// are sized no call allocates.
+class FrameExchange {
+ public:
+    struct Frame {
+        std::vector<double> x;
+        std::vector<double> y;
+        double time = 0.0;   // simulation time
+        uint64_t steps = 0;
+        uint64_t stamp = 0;  // Profiler::now() when published
+    };
+
+    // Writer side. back() is the writer's own frame until publish().
+    Frame& back();
+    void publish();
+    uint64_t published() const;
+
+    // Reader side. acquire() returns true when a newer frame than
+    // latest() has been published and takes it; the old latest() becomes
+    // previous().
+    bool acquire();
+    const Frame& latest() const;
+    const Frame& previous() const;
+
+    // Positions between previous() and latest(), written to out, and the
+    // matching simulation time. The blend factor is the time since
+    // latest() was published over the gap between the two, clamped to
+    // [0, 1]: the picture trails the simulation by one frame and moves
+    // smoothly whatever the two threads' rates.
+    double blend(uint64_t now, BodyState* out) const;
+
+ private:
+    static constexpr unsigned kFresh = 4;  // set when _middle is unread
+
+    Frame _frames[4];
+    std::atomic<unsigned> _middle{3};  // buffer in transit, | kFresh
+    std::atomic<uint64_t> _published{0};
+    unsigned _back = 0;      // writer's
+    unsigned _latest = 1;    // reader's
+    unsigned _previous = 2;  // reader's
+};
+}  // namespace NB
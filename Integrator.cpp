@@ -0,0 +1,38 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <string>
+#include "Integrator.hpp"
+
+namespace NB {
+const char* integratorName(Integrator integrator) {
+    switch (integrator) {
+    case Integrator::Leapfrog:
+        return "leapfrog";
+    case Integrator::Yoshida4:
+        return "yoshida4";
+    case Integrator::RK4:
+        return "rk4";
+    case Integrator::Block:
+        return "block";
+    case Integrator::Euler:
+    default:
+        return "euler";
+    }
+}
+
+bool parseIntegrator(const std::string& name, Integrator* integrator) {
+    for (Integrator candidate : {Integrator::Euler, Integrator::Leapfrog,
+                                 Integrator::Yoshida4, Integrator::RK4,
+                                 Integrator::Block}) {
+        if (name == integratorName(candidate)) {
+            *integrator = candidate;
+            return true;
+        }
+    }
+    if (name == "verlet") {
+        *integrator = Integrator::Leapfrog;
+        return true;
+    }
+    return false;
+}
+}  // namespace NB
@@ -0,0 +1,36 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <string>
+
+namespace NB {
+// Time integrators for Universe::step.
+//   Euler     semi-implicit (symplectic) Euler, first order, 1 force pass
+//   Leapfrog  kick-drift-kick velocity Verlet, second order, 1 force pass
+//   Yoshida4  three leapfrog substeps with Yoshida's weights, fourth order,
+//             3 force passes
+//   RK4       classical Runge-Kutta, fourth order but not symplectic,
+//             4 force passes
+//   Block     per-body power-of-two leapfrog steps (see BlockStepper); the
+//             dt given to step() is the longest step any body takes
+// The symplectic schemes reuse the accelerations left by the previous step
+// as long as nothing outside the integrator has touched the state.
+enum class Integrator { Euler, Leapfrog, Yoshida4, RK4, Block };
+
+// Compile-time shape of the kick-drift schemes; Universe instantiates its
+// step loop once per policy. A step kicks by kOpen * dt and drifts by dt
+// in one pass over the bodies, then, if kClose is not zero, evaluates the
+// forces at the new positions and kicks by kClose * dt.
+struct EulerPolicy {
+    static constexpr double kOpen = 1.0;
+    static constexpr double kClose = 0.0;
+};
+struct LeapfrogPolicy {
+    static constexpr double kOpen = 0.5;
+    static constexpr double kClose = 0.5;
+};
+
+const char* integratorName(Integrator integrator);
+bool parseIntegrator(const std::string& name, Integrator* integrator);
+}  // namespace NB
@@ -0,0 +1,70 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include "MappedFile.hpp"
+using NB::MappedFile;
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        _error = path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, info.st_size, MADV_SEQUENTIAL);
+            _map = map;
+            _length = info.st_size;
+            ::close(fd);
+            return true;
+        }
+    }
+
+    char chunk[1 << 16];
+    ssize_t got;
+    while ((got = ::read(fd, chunk, sizeof(chunk))) > 0) {
+        _buffer.append(chunk, got);
+    }
+    ::close(fd);
+    if (got < 0) {
+        _error = path + ": " + std::strerror(errno);
+        _buffer.clear();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (_map) {
+        munmap(_map, _length);
+    }
+    _map = nullptr;
+    _length = 0;
+    _buffer.clear();
+    _error.clear();
+}
+
+std::string_view MappedFile::data() const {
+    if (_map) {
+        return std::string_view(static_cast<const char*>(_map), _length);
+    }
+    return _buffer;
+}
+
+bool MappedFile::mapped() const { return _map != nullptr; }
+
+const std::string& MappedFile::error() const { return _error; }
@@ -0,0 +1,33 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace NB {
+// Read-only view of a whole file. Regular files are memory-mapped; anything
+// that cannot be mapped (pipes, /dev/stdin from a pipe) is read into memory
+// instead, so callers always get one contiguous buffer.
+class MappedFile {
+ public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool open(const std::string& path);
+    void close();
+
+    std::string_view data() const;
+    bool mapped() const;  // false when the contents were copied
+    const std::string& error() const;
+
+ private:
+    void* _map = nullptr;
+    size_t _length = 0;
+    std::string _buffer;
+    std::string _error;
+};
+}  // namespace NB
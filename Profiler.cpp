@@ -0,0 +1,223 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+#include "Profiler.hpp"
+using NB::Metric;
+using NB::Phase;
+using NB::Profiler;
+
+namespace {
+struct TraceEvent {
+    Phase phase;
+    uint32_t thread;
+    uint64_t start;
+    uint64_t end;
+};
+
+std::mutex traceLock;
+std::vector<TraceEvent> traceEvents;
+size_t traceCapacity = 0;
+std::atomic<bool> tracing{false};
+std::atomic<uint64_t> traceDropped{0};
+std::atomic<uint32_t> nextThread{0};
+const uint64_t clockOrigin = Profiler::now();
+
+// Small, stable id for the calling thread in the trace.
+uint32_t threadId() {
+    thread_local const uint32_t id = nextThread.fetch_add(1);
+    return id;
+}
+
+void countAllocation(size_t size) {
+    Profiler::count(Metric::Allocations);
+    Profiler::count(Metric::AllocatedBytes, size);
+}
+}  // namespace
+
+namespace NB {
+const char* phaseName(Phase phase) {
+    static const char* names[kPhaseCount] = {
+        "step", "forces", "tree build", "integrate", "collisions",
+        "reorder", "diagnostics", "sprites", "draw", "events", "record",
+        "checkpoint"
+    };
+    return names[static_cast<size_t>(phase)];
+}
+
+const char* metricName(Metric metric) {
+    static const char* names[kMetricCount] = {
+        "steps", "interactions", "nodes visited", "merges", "allocations",
+        "allocated bytes"
+    };
+    return names[static_cast<size_t>(metric)];
+}
+}  // namespace NB
+
+void Profiler::setEnabled(bool enabled) {
+    _enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Profiler::setTracing(bool enabled, size_t capacity) {
+    std::lock_guard<std::mutex> lock(traceLock);
+    if (enabled) {
+        traceEvents.reserve(capacity);
+        traceCapacity = capacity;
+        setEnabled(true);
+    }
+    tracing.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t Profiler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::addTime(Phase phase, uint64_t start, uint64_t end) {
+    const size_t p = static_cast<size_t>(phase);
+    _totals[p].fetch_add(end - start, std::memory_order_relaxed);
+    _calls[p].fetch_add(1, std::memory_order_relaxed);
+    if (!tracing.load(std::memory_order_relaxed)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(traceLock);
+    if (traceEvents.size() < traceCapacity) {
+        traceEvents.push_back({phase, threadId(), start, end});
+    } else {
+        traceDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+uint64_t Profiler::total(Phase phase) {
+    return _totals[static_cast<size_t>(phase)].load();
+}
+
+uint64_t Profiler::calls(Phase phase) {
+    return _calls[static_cast<size_t>(phase)].load();
+}
+
+uint64_t Profiler::value(Metric metric) {
+    return _metrics[static_cast<size_t>(metric)].load();
+}
+
+void Profiler::reset() {
+    for (size_t p = 0; p < kPhaseCount; p++) {
+        _totals[p] = 0;
+        _calls[p] = 0;
+    }
+    for (size_t m = 0; m < kMetricCount; m++) {
+        _metrics[m] = 0;
+    }
+    std::lock_guard<std::mutex> lock(traceLock);
+    traceEvents.clear();
+    traceDropped = 0;
+}
+
+void Profiler::printSummary(std::ostream& os) {
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision(3);
+    os << std::left << std::setw(12) << "phase" << std::right
+       << std::setw(10) << "calls" << std::setw(14) << "total ms"
+       << std::setw(14) << "mean us" << "\n";
+    for (size_t p = 0; p < kPhaseCount; p++) {
+        uint64_t n = _calls[p].load();
+        if (n == 0) {
+            continue;
+        }
+        double ms = _totals[p].load() / 1e6;
+        os << std::left << std::setw(12) << phaseName(static_cast<Phase>(p))
+           << std::right << std::setw(10) << n << std::setw(14) << ms
+           << std::setw(14) << ms * 1e3 / n << "\n";
+    }
+    for (size_t m = 0; m < kMetricCount; m++) {
+        os << std::left << std::setw(16) << metricName(static_cast<Metric>(m))
+           << std::right << std::setw(20) << _metrics[m].load() << "\n";
+    }
+    if (traceDropped.load() > 0) {
+        os << "trace events dropped: " << traceDropped.load() << "\n";
+    }
+    os.flags(flags);
+    os.precision(precision);
+}
+
+bool Profiler::writeTrace(const std::string& path, std::string* error) {
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        *error = "cannot create " + path;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(traceLock);
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+    for (size_t e = 0; e < traceEvents.size(); e++) {
+        const TraceEvent& event = traceEvents[e];
+        std::fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                     "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                     e ? "," : "", phaseName(event.phase), event.thread,
+                     (event.start - clockOrigin) / 1e3,
+                     (event.end - event.start) / 1e3);
+    }
+    std::fputs("\n]}\n", file);
+    if (std::fclose(file) != 0) {
+        *error = "failed writing " + path;
+        return false;
+    }
+    return true;
+}
+
+// Global allocation functions that feed Metric::Allocations. They only
+// add a relaxed counter check to malloc and free.
+void* operator new(std::size_t size) {
+    countAllocation(size);
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    countAllocation(size);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    countAllocation(size);
+    const size_t alignment = static_cast<size_t>(align);
+    size_t bytes = (size + alignment - 1) / alignment * alignment;
+    if (void* ptr = std::aligned_alloc(alignment, bytes ? bytes : alignment)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
@@ -0,0 +1,92 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace NB {
+// Timed sections. Phases nest: Step contains Forces, TreeBuild, Integrate,
+// Collisions, Reorder and Diagnostics, which may contain Forces itself;
+// Draw contains Sprites.
+enum class Phase {
+    Step, Forces, TreeBuild, Integrate, Collisions, Reorder, Diagnostics,
+    Sprites, Draw, Events, Record, Checkpoint
+};
+constexpr size_t kPhaseCount = 12;
+
+enum class Metric {
+    Steps,           // calls to Universe::step
+    Interactions,    // body-body and body-node force terms
+    NodesVisited,    // Barnes-Hut nodes popped during tree walks
+    Merges,          // bodies absorbed by collisions
+    Allocations,     // calls to operator new
+    AllocatedBytes
+};
+constexpr size_t kMetricCount = 6;
+
+const char* phaseName(Phase phase);
+const char* metricName(Metric metric);
+
+// Process-wide timers and counters. Everything is off by default; while
+// off, a timer or counter costs one relaxed atomic load and a branch, so
+// the instrumentation stays compiled into release builds. Totals are
+// atomics and may be updated from any thread.
+class Profiler {
+ public:
+    static bool enabled() {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+    static void setEnabled(bool enabled);
+
+    // Keeps every timed section for writeTrace, up to capacity events;
+    // later ones are dropped and counted. Enables the profiler.
+    static void setTracing(bool tracing, size_t capacity = 1 << 20);
+
+    static void count(Metric metric, uint64_t amount = 1) {
+        if (enabled()) {
+            _metrics[static_cast<size_t>(metric)].fetch_add(
+                amount, std::memory_order_relaxed);
+        }
+    }
+    static uint64_t now();  // steady clock, nanoseconds
+    static void addTime(Phase phase, uint64_t start, uint64_t end);
+
+    static uint64_t total(Phase phase);  // nanoseconds
+    static uint64_t calls(Phase phase);
+    static uint64_t value(Metric metric);
+    static void reset();
+
+    // Table of phase times and counters since the last reset.
+    static void printSummary(std::ostream& os);
+    // Chrome trace event JSON, for chrome://tracing or Perfetto.
+    static bool writeTrace(const std::string& path, std::string* error);
+
+ private:
+    static inline std::atomic<bool> _enabled{false};
+    static inline std::atomic<uint64_t> _metrics[kMetricCount] = {};
+    static inline std::atomic<uint64_t> _totals[kPhaseCount] = {};
+    static inline std::atomic<uint64_t> _calls[kPhaseCount] = {};
+};
+
+// Adds the time from construction to destruction to a phase.
+class ScopedTimer {
+ public:
+    explicit ScopedTimer(Phase phase):
+    _phase(phase), _start(Profiler::enabled() ? Profiler::now() : 0) {}
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+    ~ScopedTimer() {
+        if (_start != 0) {
+            Profiler::addTime(_phase, _start, Profiler::now());
+        }
+    }
+
+ private:
+    Phase _phase;
+    uint64_t _start;
+};
+}  // namespace NB
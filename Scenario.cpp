@@ -0,0 +1,313 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MappedFile.hpp"
+#include "Scenario.hpp"
+#include "Snapshot.hpp"
+#include "UniverseParser.hpp"
+using NB::BodyState;
+using NB::Scenario;
+using NB::ScenarioKind;
+using NB::ScenarioOptions;
+
+static const double G = 6.67430e-11;
+static const double kAU = 1.495978707e11;
+
+namespace {
+// Draws built straight from the 64-bit engine, whose output the standard
+// fixes, so a seed gives the same scenario with any standard library.
+class Random {
+ public:
+    explicit Random(uint64_t seed): _engine(seed) {}
+
+    double uniform() {  // (0, 1)
+        return (static_cast<double>(_engine() >> 11) + 0.5) * 0x1p-53;
+    }
+    double angle() { return 2.0 * M_PI * uniform(); }
+    double normal() {  // Box-Muller
+        return std::sqrt(-2.0 * std::log(uniform())) * std::cos(angle());
+    }
+
+ private:
+    std::mt19937_64 _engine;
+};
+
+uint32_t nameIndex(Scenario* scenario, std::string_view name) {
+    auto found = std::find(scenario->names.begin(), scenario->names.end(),
+                           name);
+    if (found == scenario->names.end()) {
+        scenario->names.emplace_back(name);
+        return static_cast<uint32_t>(scenario->names.size() - 1);
+    }
+    return static_cast<uint32_t>(found - scenario->names.begin());
+}
+
+void add(Scenario* scenario, uint32_t image, double mass, double x,
+         double y, double vx, double vy) {
+    scenario->state.push(mass, x, y, vx, vy);
+    scenario->images.push_back(image);
+}
+
+// The 3D Plummer model restricted to the plane: radii follow its mass
+// profile and speeds its distribution function (Aarseth, Henon & Wielen
+// 1974), in random directions. Not an exact equilibrium in the plane, but
+// close enough to stay bound and roughly virialized.
+void plummer(Scenario* scenario, Random& random, size_t count, double mass,
+             double a, uint32_t image) {
+    const double total = mass * count;
+    for (size_t i = 0; i < count; i++) {
+        // The outermost 0.1% of the mass reaches to infinity; leave it out.
+        double enclosed = 0.999 * random.uniform();
+        double r = a / std::sqrt(std::pow(enclosed, -2.0 / 3.0) - 1.0);
+        double q, g;
+        do {
+            q = random.uniform();
+            g = 0.1 * random.uniform();
+        } while (g > q * q * std::pow(1.0 - q * q, 3.5));
+        double escape = std::sqrt(2.0 * G * total / std::hypot(r, a));
+        double v = q * escape;
+        double theta = random.angle();
+        double phi = random.angle();
+        add(scenario, image, mass, r * std::cos(theta), r * std::sin(theta),
+            v * std::cos(phi), v * std::sin(phi));
+    }
+}
+
+// A central body of the disk's total mass and count - 1 disk bodies with
+// surface density exp(-r / h), cut at 10 h, on circular orbits for the
+// enclosed mass with 5% velocity dispersion. spin is +1 for
+// counter-clockwise rotation and -1 for clockwise.
+void disk(Scenario* scenario, Random& random, size_t count, double mass,
+          double h, double cx, double cy, double cvx, double cvy,
+          double spin, uint32_t centerImage, uint32_t image) {
+    if (count == 0) {
+        return;
+    }
+    const double diskMass = mass * (count - 1);
+    const double central = std::max(diskMass, mass);
+    add(scenario, centerImage, central, cx, cy, cvx, cvy);
+    for (size_t i = 1; i < count; i++) {
+        double r;
+        do {
+            r = -h * std::log(random.uniform() * random.uniform());
+        } while (r > 10.0 * h);
+        double x = r / h;
+        double enclosed = central
+                        + diskMass * (1.0 - (1.0 + x) * std::exp(-x));
+        double v = std::sqrt(G * enclosed / r);
+        double theta = random.angle();
+        double vx = -spin * v * std::sin(theta) + 0.05 * v * random.normal();
+        double vy = spin * v * std::cos(theta) + 0.05 * v * random.normal();
+        add(scenario, image, mass, cx + r * std::cos(theta),
+            cy + r * std::sin(theta), cvx + vx, cvy + vy);
+    }
+}
+
+bool belt(Scenario* scenario, Random& random, const ScenarioOptions& options,
+          double mass, double inner, uint32_t image, std::string* error) {
+    NB::MappedFile file;
+    if (!file.open(options.base)) {
+        *error = file.error();
+        return false;
+    }
+    NB::UniverseReader reader(file.data());
+    size_t count = 0;
+    double radius = 0.0;
+    NB::BodyRecord record;
+    if (reader.readHeader(&count, &radius)) {
+        // Every body line takes at least 11 characters, which bounds the
+        // reservation when the count in the header is wrong.
+        const size_t bodies = std::min(count, file.data().size() / 11 + 1)
+                            + options.count;
+        scenario->state.reserve(bodies);
+        scenario->images.reserve(bodies);
+        while (reader.next(&record)) {
+            add(scenario, nameIndex(scenario, record.image), record.mass,
+                record.x, record.y, record.vx, record.vy);
+        }
+    }
+    if (!reader.done()) {
+        *error = options.base + ": " + reader.error().describe();
+        return false;
+    }
+    if (count == 0) {
+        *error = options.base + ": no body to orbit";
+        return false;
+    }
+
+    const BodyState& st = scenario->state;
+    size_t sun = std::max_element(st.mass.begin(), st.mass.end())
+               - st.mass.begin();
+    const double sunX = st.x[sun], sunY = st.y[sun];
+    const double sunVx = st.vx[sun], sunVy = st.vy[sun];
+    const double mu = G * st.mass[sun];
+    const double outer = 1.5 * inner;
+
+    for (size_t i = 0; i < options.count; i++) {
+        double a = inner + (outer - inner) * random.uniform();
+        double v = std::sqrt(mu / a) * (1.0 + 0.02 * random.normal());
+        double theta = random.angle();
+        add(scenario, image, mass * (0.01 + random.uniform()),
+            sunX + a * std::cos(theta), sunY + a * std::sin(theta),
+            sunVx - v * std::sin(theta), sunVy + v * std::cos(theta));
+    }
+    scenario->radius = std::max(radius, 1.05 * outer);
+    return true;
+}
+
+// Moves the centre of mass to rest at the origin.
+void recentre(BodyState* state) {
+    double m = 0, x = 0, y = 0, vx = 0, vy = 0;
+    for (size_t i = 0; i < state->size(); i++) {
+        m += state->mass[i];
+        x += state->mass[i] * state->x[i];
+        y += state->mass[i] * state->y[i];
+        vx += state->mass[i] * state->vx[i];
+        vy += state->mass[i] * state->vy[i];
+    }
+    if (m <= 0) {
+        return;
+    }
+    for (size_t i = 0; i < state->size(); i++) {
+        state->x[i] -= x / m;
+        state->y[i] -= y / m;
+        state->vx[i] -= vx / m;
+        state->vy[i] -= vy / m;
+    }
+}
+}  // namespace
+
+namespace NB {
+const char* scenarioName(ScenarioKind kind) {
+    switch (kind) {
+    case ScenarioKind::Disk:
+        return "disk";
+    case ScenarioKind::Belt:
+        return "belt";
+    case ScenarioKind::Galaxies:
+        return "galaxies";
+    case ScenarioKind::Plummer:
+    default:
+        return "plummer";
+    }
+}
+
+bool parseScenario(const std::string& name, ScenarioKind* kind) {
+    for (ScenarioKind candidate : {ScenarioKind::Plummer, ScenarioKind::Disk,
+                                   ScenarioKind::Belt,
+                                   ScenarioKind::Galaxies}) {
+        if (name == scenarioName(candidate)) {
+            *kind = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool generateScenario(const ScenarioOptions& options, Scenario* scenario,
+                      std::string* error) {
+    *scenario = Scenario();
+    Random random(options.seed);
+    const bool asteroids = options.kind == ScenarioKind::Belt;
+    const double mass = options.mass > 0 ? options.mass
+                      : asteroids ? 1.0e18 : 2.0e30;
+    const double scale = options.scale > 0 ? options.scale
+                       : asteroids ? 2.2 * kAU : 1.0e13;
+    const uint32_t image = nameIndex(scenario, !options.image.empty()
+                                     ? options.image
+                                     : asteroids ? "comet.gif" : "sun.gif");
+
+    if (asteroids) {
+        return belt(scenario, random, options, mass, scale, image, error);
+    }
+
+    scenario->state.reserve(options.count);
+    scenario->images.reserve(options.count);
+    switch (options.kind) {
+    case ScenarioKind::Disk:
+        disk(scenario, random, options.count, mass, scale, 0, 0, 0, 0, 1.0,
+             nameIndex(scenario, "death_star.gif"), image);
+        scenario->radius = 5.0 * scale;
+        break;
+    case ScenarioKind::Galaxies: {
+        // Centres 8 scale lengths apart with an impact parameter of 2,
+        // closing at the speed of a parabolic encounter.
+        const size_t first = options.count / 2;
+        const double total = mass * options.count * 2;
+        const double v = 0.5 * std::sqrt(2.0 * G * total / (8.0 * scale));
+        const uint32_t center = nameIndex(scenario, "death_star.gif");
+        disk(scenario, random, first, mass, scale, -4 * scale, -scale,
+             v, 0, 1.0, center, image);
+        disk(scenario, random, options.count - first, mass, scale,
+             4 * scale, scale, -v, 0, -1.0, center, image);
+        scenario->radius = 10.0 * scale;
+        break;
+    }
+    case ScenarioKind::Plummer:
+    default:
+        plummer(scenario, random, options.count, mass, scale, image);
+        scenario->radius = 5.0 * scale;
+        break;
+    }
+    recentre(&scenario->state);
+    return true;
+}
+
+bool writeScenarioText(const Scenario& scenario, std::FILE* file) {
+    const BodyState& st = scenario.state;
+    std::vector<char> buffer(1 << 20);
+    size_t used = 0;
+    bool ok = true;
+    auto flush = [&] {
+        ok = ok && std::fwrite(buffer.data(), 1, used, file) == used;
+        used = 0;
+    };
+    auto append = [&](auto value, char separator) {
+        auto result = std::to_chars(buffer.data() + used,
+                                    buffer.data() + buffer.size(), value);
+        used = result.ptr - buffer.data();
+        buffer[used++] = separator;
+    };
+    auto appendName = [&](const std::string& name) {
+        if (buffer.size() - used < name.size() + 1) {
+            flush();
+        }
+        std::copy(name.begin(), name.end(), buffer.data() + used);
+        used += name.size();
+        buffer[used++] = '\n';
+    };
+
+    append(st.size(), '\n');
+    append(scenario.radius, '\n');
+    for (size_t i = 0; i < st.size(); i++) {
+        // Five numbers of at most 24 characters plus separators.
+        if (buffer.size() - used < 5 * 25) {
+            flush();
+        }
+        append(st.x[i], ' ');
+        append(st.y[i], ' ');
+        append(st.vx[i], ' ');
+        append(st.vy[i], ' ');
+        append(st.mass[i], ' ');
+        appendName(scenario.names[scenario.images[i]]);
+    }
+    flush();
+    return ok;
+}
+
+bool writeScenarioSnapshot(const Scenario& scenario, const std::string& path,
+                           std::string* error) {
+    std::vector<std::string_view> names(scenario.names.begin(),
+                                        scenario.names.end());
+    return writeSnapshot(path, scenario.state, scenario.radius, names,
+                         scenario.images, SnapshotInfo(), error);
+}
+}  // namespace NB
@@ -0,0 +1,52 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "BodyState.hpp"
+
+namespace NB {
+// Synthetic initial conditions for scale tests.
+//   Plummer   Plummer sphere of scale radius `scale`, laid in the plane,
+//             velocities drawn from the Plummer distribution function
+//   Disk      exponential disk of scale length `scale` around a central
+//             mass, on near-circular orbits
+//   Belt      the bodies of `base` (e.g. planets.txt) plus an asteroid
+//             belt on near-circular orbits around its most massive body,
+//             between 2.2 and 3.3 AU unless `scale` gives the inner edge
+//   Galaxies  two disks of half the bodies each on a collision course
+enum class ScenarioKind { Plummer, Disk, Belt, Galaxies };
+
+const char* scenarioName(ScenarioKind kind);
+bool parseScenario(const std::string& name, ScenarioKind* kind);
+
+struct ScenarioOptions {
+    ScenarioKind kind = ScenarioKind::Plummer;
+    size_t count = 1000;   // generated bodies (the belt adds base bodies)
+    uint64_t seed = 1;     // the same seed gives the same bits everywhere
+    double mass = 0.0;     // per body in kg, 0 for the kind's default
+    double scale = 0.0;    // length scale in m, 0 for the kind's default
+    std::string base = "planets.txt";  // Belt only
+    std::string image;     // image for generated bodies, "" for default
+};
+
+// Bodies in state order; images[i] indexes names.
+struct Scenario {
+    BodyState state;
+    double radius = 0.0;  // universe radius that frames the bodies
+    std::vector<std::string> names;
+    std::vector<uint32_t> images;
+};
+
+bool generateScenario(const ScenarioOptions& options, Scenario* scenario,
+                      std::string* error);
+
+// The text format NBody reads, numbers in shortest round-trip form.
+bool writeScenarioText(const Scenario& scenario, std::FILE* file);
+// A snapshot NBody can --resume from (see Snapshot.hpp).
+bool writeScenarioSnapshot(const Scenario& scenario, const std::string& path,
+                           std::string* error);
+}  // namespace NB
@@ -0,0 +1,257 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <algorithm>
+#include <cmath>
+#include "SimdKernel.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NB_X86 1
+#endif
+
+using NB::BodyState;
+using NB::SimdLevel;
+
+static const double G = 6.67430e-11;
+
+// Normalized squared distances below this are treated as coincident and
+// skipped, which also drops the i == j term without a branch.
+static const double kMinR2 = 1e-30;
+
+namespace {
+void scalarRows(const BodyState& state, size_t begin, size_t end,
+                double invL, double soft, double gScale,
+                double* ax, double* ay) {
+    const size_t n = state.size();
+    const double* x = state.x.data();
+    const double* y = state.y.data();
+    const double* m = state.mass.data();
+
+    for (size_t i = begin; i < end; i++) {
+        const double xi = x[i];
+        const double yi = y[i];
+        double sx = 0.0;
+        double sy = 0.0;
+        for (size_t j = 0; j < n; j++) {
+            double dx = (x[j] - xi) * invL;
+            double dy = (y[j] - yi) * invL;
+            double r2 = dx * dx + dy * dy + soft;
+            if (r2 > kMinR2) {
+                double inv = 1.0 / std::sqrt(r2);
+                double s = m[j] * inv * inv * inv;
+                sx += dx * s;
+                sy += dy * s;
+            }
+        }
+        ax[i] = gScale * sx;
+        ay[i] = gScale * sy;
+    }
+}
+
+// Scalar tail shared by the vector paths for the last n % width bodies.
+void scalarTail(const BodyState& state, size_t i, size_t j0,
+                double invL, double soft, double* sx, double* sy) {
+    const double* x = state.x.data();
+    const double* y = state.y.data();
+    const double* m = state.mass.data();
+    for (size_t j = j0; j < state.size(); j++) {
+        double dx = (x[j] - x[i]) * invL;
+        double dy = (y[j] - y[i]) * invL;
+        double r2 = dx * dx + dy * dy + soft;
+        if (r2 > kMinR2) {
+            double inv = 1.0 / std::sqrt(r2);
+            double s = m[j] * inv * inv * inv;
+            *sx += dx * s;
+            *sy += dy * s;
+        }
+    }
+}
+
+#ifdef NB_X86
+__attribute__((target("avx2,fma")))
+void avx2Rows(const BodyState& state, size_t begin, size_t end,
+              double invL, double soft, double gScale,
+              double* ax, double* ay) {
+    const size_t n = state.size();
+    const size_t body = n - n % 4;
+    const double* x = state.x.data();
+    const double* y = state.y.data();
+    const double* m = state.mass.data();
+    const __m256d scale = _mm256_set1_pd(invL);
+    const __m256d threeHalves = _mm256_set1_pd(1.5);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d minR2 = _mm256_set1_pd(kMinR2);
+    const __m256d softening = _mm256_set1_pd(soft);
+
+    for (size_t i = begin; i < end; i++) {
+        const __m256d xi = _mm256_set1_pd(x[i]);
+        const __m256d yi = _mm256_set1_pd(y[i]);
+        __m256d sx = _mm256_setzero_pd();
+        __m256d sy = _mm256_setzero_pd();
+
+        for (size_t j = 0; j < body; j += 4) {
+            __m256d xj = _mm256_loadu_pd(x + j);
+            __m256d yj = _mm256_loadu_pd(y + j);
+            __m256d mj = _mm256_loadu_pd(m + j);
+            __m256d dx = _mm256_mul_pd(_mm256_sub_pd(xj, xi), scale);
+            __m256d dy = _mm256_mul_pd(_mm256_sub_pd(yj, yi), scale);
+            __m256d r2 = _mm256_fmadd_pd(dx, dx,
+                                         _mm256_fmadd_pd(dy, dy, softening));
+
+            // 12-bit estimate, then two Newton steps: y *= 1.5 - r2/2 y^2.
+            __m256d inv = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(r2)));
+            __m256d hr2 = _mm256_mul_pd(half, r2);
+            inv = _mm256_mul_pd(inv, _mm256_fnmadd_pd(
+                _mm256_mul_pd(hr2, inv), inv, threeHalves));
+            inv = _mm256_mul_pd(inv, _mm256_fnmadd_pd(
+                _mm256_mul_pd(hr2, inv), inv, threeHalves));
+            inv = _mm256_and_pd(inv, _mm256_cmp_pd(r2, minR2, _CMP_GT_OQ));
+
+            __m256d s = _mm256_mul_pd(mj,
+                _mm256_mul_pd(inv, _mm256_mul_pd(inv, inv)));
+            sx = _mm256_fmadd_pd(dx, s, sx);
+            sy = _mm256_fmadd_pd(dy, s, sy);
+        }
+
+        alignas(32) double lx[4];
+        alignas(32) double ly[4];
+        _mm256_store_pd(lx, sx);
+        _mm256_store_pd(ly, sy);
+        double tx = (lx[0] + lx[1]) + (lx[2] + lx[3]);
+        double ty = (ly[0] + ly[1]) + (ly[2] + ly[3]);
+        scalarTail(state, i, body, invL, soft, &tx, &ty);
+        ax[i] = gScale * tx;
+        ay[i] = gScale * ty;
+    }
+}
+
+__attribute__((target("avx512f")))
+void avx512Rows(const BodyState& state, size_t begin, size_t end,
+                double invL, double soft, double gScale,
+                double* ax, double* ay) {
+    const size_t n = state.size();
+    const size_t body = n - n % 8;
+    const double* x = state.x.data();
+    const double* y = state.y.data();
+    const double* m = state.mass.data();
+    const __m512d scale = _mm512_set1_pd(invL);
+    const __m512d threeHalves = _mm512_set1_pd(1.5);
+    const __m512d half = _mm512_set1_pd(0.5);
+    const __m512d minR2 = _mm512_set1_pd(kMinR2);
+    const __m512d softening = _mm512_set1_pd(soft);
+
+    for (size_t i = begin; i < end; i++) {
+        const __m512d xi = _mm512_set1_pd(x[i]);
+        const __m512d yi = _mm512_set1_pd(y[i]);
+        __m512d sx = _mm512_setzero_pd();
+        __m512d sy = _mm512_setzero_pd();
+
+        for (size_t j = 0; j < body; j += 8) {
+            __m512d xj = _mm512_loadu_pd(x + j);
+            __m512d yj = _mm512_loadu_pd(y + j);
+            __m512d mj = _mm512_loadu_pd(m + j);
+            __m512d dx = _mm512_mul_pd(_mm512_sub_pd(xj, xi), scale);
+            __m512d dy = _mm512_mul_pd(_mm512_sub_pd(yj, yi), scale);
+            __m512d r2 = _mm512_fmadd_pd(dx, dx,
+                                         _mm512_fmadd_pd(dy, dy, softening));
+            __mmask8 live = _mm512_cmp_pd_mask(r2, minR2, _CMP_GT_OQ);
+
+            // 14-bit estimate, then two Newton steps.
+            __m512d inv = _mm512_maskz_rsqrt14_pd(live, r2);
+            __m512d hr2 = _mm512_mul_pd(half, r2);
+            inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(
+                _mm512_mul_pd(hr2, inv), inv, threeHalves));
+            inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(
+                _mm512_mul_pd(hr2, inv), inv, threeHalves));
+
+            __m512d s = _mm512_mul_pd(mj,
+                _mm512_mul_pd(inv, _mm512_mul_pd(inv, inv)));
+            sx = _mm512_fmadd_pd(dx, s, sx);
+            sy = _mm512_fmadd_pd(dy, s, sy);
+        }
+
+        // Stored and summed by hand: GCC 12 warns about the undefined
+        // lanes inside _mm512_reduce_add_pd once optimization is on.
+        alignas(64) double lx[8];
+        alignas(64) double ly[8];
+        _mm512_store_pd(lx, sx);
+        _mm512_store_pd(ly, sy);
+        double tx = ((lx[0] + lx[4]) + (lx[2] + lx[6]))
+                  + ((lx[1] + lx[5]) + (lx[3] + lx[7]));
+        double ty = ((ly[0] + ly[4]) + (ly[2] + ly[6]))
+                  + ((ly[1] + ly[5]) + (ly[3] + ly[7]));
+        scalarTail(state, i, body, invL, soft, &tx, &ty);
+        ax[i] = gScale * tx;
+        ay[i] = gScale * ty;
+    }
+}
+#endif
+}  // namespace
+
+namespace NB {
+SimdLevel detectSimdLevel() {
+#ifdef NB_X86
+    static const SimdLevel level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            return SimdLevel::AVX512;
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return SimdLevel::AVX2;
+        }
+        return SimdLevel::Scalar;
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::AVX512:
+        return "avx512";
+    case SimdLevel::AVX2:
+        return "avx2";
+    case SimdLevel::Scalar:
+    default:
+        return "scalar";
+    }
+}
+
+void simdAccelerations(const BodyState& state, size_t begin, size_t end,
+                       double extent, double softening2, SimdLevel level,
+                       double* ax, double* ay) {
+    const double invL = 1.0 / extent;
+    const double soft = softening2 * invL * invL;
+    const double gScale = G * invL * invL;
+    const SimdLevel best = detectSimdLevel();
+    if (static_cast<int>(level) > static_cast<int>(best)) {
+        level = best;
+    }
+
+    switch (level) {
+#ifdef NB_X86
+    case SimdLevel::AVX512:
+        avx512Rows(state, begin, end, invL, soft, gScale, ax, ay);
+        break;
+    case SimdLevel::AVX2:
+        avx2Rows(state, begin, end, invL, soft, gScale, ax, ay);
+        break;
+#endif
+    default:
+        scalarRows(state, begin, end, invL, soft, gScale, ax, ay);
+        break;
+    }
+}
+
+double stateExtent(const BodyState& state) {
+    if (state.size() == 0) {
+        return 1.0;
+    }
+    auto [minX, maxX] = std::minmax_element(state.x.begin(), state.x.end());
+    auto [minY, maxY] = std::minmax_element(state.y.begin(), state.y.end());
+    double extent = std::max(*maxX - *minX, *maxY - *minY);
+    return extent > 0 ? extent : 1.0;
+}
+}  // namespace NB
@@ -0,0 +1,30 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstddef>
+#include "BodyState.hpp"
+
+namespace NB {
+// Instruction sets the vectorized gravity kernel can run on. Scalar is the
+// portable fallback and uses the same formulation as the vector paths.
+enum class SimdLevel { Scalar, AVX2, AVX512 };
+
+// Best level supported by the CPU we are running on, detected once.
+SimdLevel detectSimdLevel();
+const char* simdLevelName(SimdLevel level);
+
+// Full-row gravity kernel: for every i in [begin, end), sums the
+// acceleration from all other bodies into ax[i]/ay[i]. Lanes run over j,
+// using an approximate reciprocal square root refined by Newton steps and
+// fused multiply-adds. Coordinates are normalized by `extent` so the
+// single-precision estimate cannot overflow at astronomical distances.
+// softening2 is the squared Plummer softening length, as in DirectSum.
+// Levels the CPU lacks fall back to Scalar.
+void simdAccelerations(const BodyState& state, size_t begin, size_t end,
+                       double extent, double softening2, SimdLevel level,
+                       double* ax, double* ay);
+
+// Largest coordinate span of the bodies, for the normalization above.
+double stateExtent(const BodyState& state);
+}  // namespace NB
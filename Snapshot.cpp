@@ -0,0 +1,221 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Snapshot.hpp"
+using NB::BodyState;
+using NB::ParseError;
+using NB::SnapshotHeader;
+using NB::SnapshotInfo;
+using NB::SnapshotReader;
+
+static const char kMagic[8] = {'N', 'B', 'S', 'N', 'A', 'P', '\0', '\0'};
+static const uint32_t kVersion = 1;
+static const uint32_t kByteOrder = 0x01020304;
+static const uint64_t kAlign = 64;
+
+static uint64_t alignUp(uint64_t offset) {
+    return (offset + kAlign - 1) / kAlign * kAlign;
+}
+
+namespace NB {
+bool syncDirectory(const std::string& path) {
+    const size_t slash = path.rfind('/');
+    const std::string directory = slash == std::string::npos ? "."
+                                : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+SnapshotHeader snapshotHeader(uint64_t count, double radius,
+                              const std::vector<std::string_view>& names,
+                              const SnapshotInfo& info) {
+    SnapshotHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byteOrder = kByteOrder;
+    header.headerSize = sizeof(SnapshotHeader);
+    header.count = count;
+    header.steps = info.steps;
+    header.time = info.time;
+    header.radius = radius;
+    header.imageOffset = sizeof(SnapshotHeader);
+    header.namesOffset = header.imageOffset + count * sizeof(uint32_t);
+    header.namesCount = names.size();
+    header.namesBytes = 0;
+    for (std::string_view name : names) {
+        header.namesBytes += name.size() + 1;
+    }
+    header.arrayOffset = alignUp(header.namesOffset + header.namesBytes);
+    header.arrayStride = alignUp(count * sizeof(double));
+    return header;
+}
+
+bool writeSnapshot(const std::string& path, const BodyState& state,
+                   double radius, const std::vector<std::string_view>& names,
+                   const std::vector<uint32_t>& images,
+                   const SnapshotInfo& info, std::string* error) {
+    const uint64_t n = state.size();
+    const SnapshotHeader header = snapshotHeader(n, radius, names, info);
+
+    const std::string temporary = path + ".tmp";
+    std::FILE* out = std::fopen(temporary.c_str(), "wb");
+    if (!out) {
+        *error = "cannot create " + temporary;
+        return false;
+    }
+
+    bool written = true;
+    auto put = [&](const void* data, size_t size) {
+        written = written && std::fwrite(data, 1, size, out) == size;
+    };
+    static const char zeros[kAlign] = {};
+    auto pad = [&](uint64_t done, uint64_t target) {
+        put(zeros, target - done);
+    };
+
+    put(&header, sizeof(header));
+    put(images.data(), n * sizeof(uint32_t));
+    for (std::string_view name : names) {
+        put(name.data(), name.size());
+        put("", 1);
+    }
+    pad(header.namesOffset + header.namesBytes, header.arrayOffset);
+
+    for (const AlignedVector<double>* array :
+         {&state.x, &state.y, &state.vx, &state.vy, &state.mass}) {
+        put(array->data(), n * sizeof(double));
+        pad(n * sizeof(double), header.arrayStride);
+    }
+
+    // The data reaches the disk before the rename can expose it, so a
+    // crash leaves either the old snapshot or the whole new one.
+    written = written && std::fflush(out) == 0 && ::fsync(fileno(out)) == 0;
+    written = std::fclose(out) == 0 && written;
+    if (!written) {
+        *error = "failed writing " + temporary;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        *error = "cannot replace " + path;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    if (!syncDirectory(path)) {
+        *error = "cannot sync the directory of " + path;
+        return false;
+    }
+    return true;
+}
+}  // namespace NB
+
+bool SnapshotReader::open(const std::string& path, ParseError* error) {
+    auto fail = [&](const std::string& message) {
+        *error = {0, path + ": " + message};
+        return false;
+    };
+
+    if (!_file.open(path)) {
+        *error = {0, _file.error()};
+        return false;
+    }
+    std::string_view data = _file.data();
+    if (data.size() < sizeof(SnapshotHeader)) {
+        return fail("too short for a snapshot");
+    }
+    std::memcpy(&_header, data.data(), sizeof(SnapshotHeader));
+    if (std::memcmp(_header.magic, kMagic, sizeof(kMagic)) != 0) {
+        return fail("not a snapshot file");
+    }
+    if (_header.byteOrder != kByteOrder) {
+        return fail("written on a machine with another byte order");
+    }
+    if (_header.version != kVersion ||
+        _header.headerSize != sizeof(SnapshotHeader)) {
+        return fail("unsupported snapshot version "
+                    + std::to_string(_header.version));
+    }
+
+    const uint64_t n = _header.count;
+    const uint64_t length = data.size();
+    const uint64_t maxCount = length / (5 * sizeof(double));
+    // Sizes are compared with what is left after an offset, so a corrupt
+    // header cannot wrap a sum around past the check.
+    if (n > maxCount ||
+        _header.imageOffset > length ||
+        n * sizeof(uint32_t) > length - _header.imageOffset ||
+        _header.namesOffset > length ||
+        _header.namesBytes > length - _header.namesOffset ||
+        _header.arrayStride < n * sizeof(double) ||
+        _header.arrayOffset > length ||
+        (length - _header.arrayOffset) / 5 < _header.arrayStride) {
+        return fail("truncated or corrupt");
+    }
+
+    _names.clear();
+    _names.reserve(_header.namesCount);
+    std::string_view table = data.substr(_header.namesOffset,
+                                         _header.namesBytes);
+    while (!table.empty()) {
+        size_t end = table.find('\0');
+        if (end == std::string_view::npos) {
+            return fail("corrupt image name table");
+        }
+        _names.push_back(table.substr(0, end));
+        table.remove_prefix(end + 1);
+    }
+    if (_names.size() != _header.namesCount) {
+        return fail("corrupt image name table");
+    }
+
+    _images = data.data() + _header.imageOffset;
+    _arrays = data.data() + _header.arrayOffset;
+    for (size_t i = 0; i < n; i++) {
+        if (image(i) >= _names.size()) {
+            return fail("body " + std::to_string(i)
+                        + " has no image name");
+        }
+    }
+    return true;
+}
+
+size_t SnapshotReader::size() const { return _header.count; }
+
+double SnapshotReader::radius() const { return _header.radius; }
+
+SnapshotInfo SnapshotReader::info() const {
+    return {_header.time, _header.steps};
+}
+
+const std::vector<std::string_view>& SnapshotReader::names() const {
+    return _names;
+}
+
+uint32_t SnapshotReader::image(size_t i) const {
+    uint32_t image;
+    std::memcpy(&image, _images + i * sizeof(uint32_t), sizeof(image));
+    return image;
+}
+
+// The copies go through memcpy so a file read into an unaligned buffer
+// (the pipe fallback of MappedFile) works as well as a mapped one.
+void SnapshotReader::body(size_t i, BodyRecord* record) const {
+    double* fields[] = {&record->x, &record->y, &record->vx, &record->vy,
+                        &record->mass};
+    for (size_t k = 0; k < 5; k++) {
+        std::memcpy(fields[k], _arrays + k * _header.arrayStride
+                    + i * sizeof(double), sizeof(double));
+    }
+    record->image = _names[image(i)];
+}
@@ -0,0 +1,81 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "BodyState.hpp"
+#include "MappedFile.hpp"
+#include "UniverseParser.hpp"
+
+namespace NB {
+// Where a run stood when the snapshot was taken.
+struct SnapshotInfo {
+    double time = 0.0;   // simulated seconds
+    uint64_t steps = 0;  // calls to Universe::step
+};
+
+// Snapshot file, version 1, native byte order (checked on load):
+//   SnapshotHeader
+//   image index per body, uint32
+//   image names, each terminated by '\0'
+//   x, y, vx, vy, mass: count doubles each, every array starting on a
+//   64-byte boundary so a mapped file can be read in place
+// Values are stored exactly, unlike the text format.
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t headerSize;
+    uint64_t count;
+    uint64_t steps;
+    double time;
+    double radius;
+    uint64_t imageOffset;
+    uint64_t namesOffset;
+    uint64_t namesBytes;
+    uint64_t namesCount;
+    uint64_t arrayOffset;
+    uint64_t arrayStride;  // bytes from one array to the next
+};
+
+// The header of a snapshot of count bodies with the given image names,
+// laid out as writeSnapshot writes it.
+SnapshotHeader snapshotHeader(uint64_t count, double radius,
+                              const std::vector<std::string_view>& names,
+                              const SnapshotInfo& info);
+
+// Flushes path's directory to disk, so a rename into it survives a crash.
+bool syncDirectory(const std::string& path);
+
+// Writes to path + ".tmp", flushes it to disk and renames it over path, so
+// neither an interrupted checkpoint nor a crash destroys the previous one.
+// images[i] is the index into names of body i's image file.
+bool writeSnapshot(const std::string& path, const BodyState& state,
+                   double radius, const std::vector<std::string_view>& names,
+                   const std::vector<uint32_t>& images,
+                   const SnapshotInfo& info, std::string* error);
+
+// Memory-mapped, validated view of a snapshot file.
+class SnapshotReader {
+ public:
+    bool open(const std::string& path, ParseError* error);
+
+    size_t size() const;
+    double radius() const;
+    SnapshotInfo info() const;
+    const std::vector<std::string_view>& names() const;
+    uint32_t image(size_t i) const;  // index into names() of body i's image
+    void body(size_t i, BodyRecord* record) const;
+
+ private:
+    MappedFile _file;
+    SnapshotHeader _header{};
+    std::vector<std::string_view> _names;
+    const char* _images = nullptr;
+    const char* _arrays = nullptr;
+};
+}  // namespace NB
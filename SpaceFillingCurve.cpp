@@ -0,0 +1,65 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "SpaceFillingCurve.hpp"
+using NB::BodyState;
+
+namespace NB {
+// The classic digit-by-digit conversion: each level picks the quadrant,
+// adds the cells of the quadrants before it, and rotates or reflects the
+// rest of the grid into that quadrant's frame.
+uint64_t hilbertKey(uint32_t x, uint32_t y) {
+    uint64_t key = 0;
+    for (uint32_t s = 1u << 31; s > 0; s >>= 1) {
+        const uint32_t rx = (x & s) ? 1 : 0;
+        const uint32_t ry = (y & s) ? 1 : 0;
+        key += uint64_t(s) * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = ~x;
+                y = ~y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return key;
+}
+
+void hilbertOrder(const BodyState& state,
+                  std::vector<std::pair<uint64_t, uint32_t>>* keys,
+                  std::vector<uint32_t>* order) {
+    const size_t n = state.size();
+    keys->resize(n);
+    order->resize(n);
+    if (n == 0) {
+        return;
+    }
+
+    double minX = state.x[0], maxX = state.x[0];
+    double minY = state.y[0], maxY = state.y[0];
+    for (size_t i = 1; i < n; i++) {
+        minX = std::min(minX, state.x[i]);
+        maxX = std::max(maxX, state.x[i]);
+        minY = std::min(minY, state.y[i]);
+        maxY = std::max(maxY, state.y[i]);
+    }
+    const double side = std::max(maxX - minX, maxY - minY);
+    // The side spans just under 2^32 cells, so the far edge stays in range.
+    const double cells = side > 0 ? 4294967040.0 / side : 0.0;
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t cx = static_cast<uint32_t>((state.x[i] - minX) * cells);
+        uint32_t cy = static_cast<uint32_t>((state.y[i] - minY) * cells);
+        (*keys)[i] = {hilbertKey(cx, cy), static_cast<uint32_t>(i)};
+    }
+    // Pairs compare by key, then index, which keeps ties stable.
+    std::sort(keys->begin(), keys->end());
+    for (size_t k = 0; k < n; k++) {
+        (*order)[k] = (*keys)[k].second;
+    }
+}
+}  // namespace NB
@@ -0,0 +1,23 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "BodyState.hpp"
+
+namespace NB {
+// Distance along the Hilbert curve through a 2^32 x 2^32 grid of the cell
+// (x, y). Cells next to each other on the curve are next to each other in
+// the plane, and unlike the Morton order the curve never jumps.
+uint64_t hilbertKey(uint32_t x, uint32_t y);
+
+// Sorts the bodies of state along the Hilbert curve through their bounding
+// square: order[k] is the index of the body that comes k-th. Bodies in the
+// same cell keep their relative order. keys is scratch space, kept so that
+// repeated calls do not allocate.
+void hilbertOrder(const BodyState& state,
+                  std::vector<std::pair<uint64_t, uint32_t>>* keys,
+                  std::vector<uint32_t>* order);
+}  // namespace NB
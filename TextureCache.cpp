@@ -0,0 +1,52 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <SFML/Graphics.hpp>
+#include "TextureCache.hpp"
+using NB::TextureCache;
+
+TextureCache& TextureCache::global() {
+    static TextureCache cache;
+    return cache;
+}
+
+std::shared_ptr<sf::Texture> TextureCache::get(const std::string& filename) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    if (!_enabled) {
+        return nullptr;
+    }
+
+    auto found = _textures.find(filename);
+    if (found != _textures.end()) {
+        return found->second;
+    }
+
+    auto texture = std::make_shared<sf::Texture>();
+    if (!texture->loadFromFile(filename)) {
+        return nullptr;
+    }
+    _textures.emplace(filename, texture);
+    return texture;
+}
+
+void TextureCache::setEnabled(bool enabled) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _enabled = enabled;
+}
+
+bool TextureCache::enabled() const {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _enabled;
+}
+
+size_t TextureCache::size() const {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _textures.size();
+}
+
+void TextureCache::clear() {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _textures.clear();
+}
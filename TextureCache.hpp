@@ -0,0 +1,33 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <SFML/Graphics.hpp>
+
+namespace NB {
+// Process-wide cache of decoded textures keyed by file name, so every body
+// that uses the same image shares one texture and the file is decoded
+// once. When disabled (headless runs) nothing is ever loaded.
+class TextureCache {
+ public:
+    static TextureCache& global();
+
+    // The texture for the file, decoding it on first use. Returns null if
+    // the cache is disabled or the file cannot be loaded.
+    std::shared_ptr<sf::Texture> get(const std::string& filename);
+
+    void setEnabled(bool enabled);
+    bool enabled() const;
+    size_t size() const;
+    void clear();
+
+ private:
+    mutable std::mutex _mutex;
+    std::unordered_map<std::string, std::shared_ptr<sf::Texture>> _textures;
+    bool _enabled = true;
+};
+}  // namespace NB
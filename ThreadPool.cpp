@@ -0,0 +1,132 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ThreadPool.hpp"
+using NB::ThreadPool;
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threads; i++) {
+        _queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 1; i < threads; i++) {
+        _workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::threads() const { return _queues.size(); }
+
+void ThreadPool::parallelFor(size_t begin, size_t end, size_t grain,
+                             const RangeFn& body) {
+    if (begin >= end) {
+        return;
+    }
+    grain = std::max<size_t>(grain, 1);
+    if (_workers.empty() || end - begin <= grain) {
+        body(begin, end, 0);
+        return;
+    }
+
+    const size_t chunks = (end - begin + grain - 1) / grain;
+    const size_t threads = _queues.size();
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        _body = &body;
+        _pending = chunks;
+    }
+
+    // Each worker starts with a contiguous block of chunks so that, absent
+    // stealing, it walks memory in order.
+    for (size_t t = 0; t < threads; t++) {
+        size_t first = chunks * t / threads;
+        size_t last = chunks * (t + 1) / threads;
+        Queue& queue = *_queues[t];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.clear();
+        for (size_t c = first; c < last; c++) {
+            size_t lo = begin + c * grain;
+            queue.tasks.emplace_back(lo, std::min(end, lo + grain));
+        }
+        queue.head = 0;
+        queue.tail = queue.tasks.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        _generation++;
+    }
+    _wake.notify_all();
+
+    runTasks(0);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [this] { return _pending == 0; });
+    _body = nullptr;
+}
+
+void ThreadPool::workerLoop(size_t id) {
+    size_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [&] { return _stop || _generation != seen; });
+            if (_stop) {
+                return;
+            }
+            seen = _generation;
+        }
+        runTasks(id);
+    }
+}
+
+void ThreadPool::runTasks(size_t id) {
+    Range range;
+    while (popLocal(id, &range) || steal(id, &range)) {
+        (*_body)(range.first, range.second, id);
+        if (--_pending == 0) {
+            std::lock_guard<std::mutex> guard(_mutex);
+            _done.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::popLocal(size_t id, Range* range) {
+    Queue& queue = *_queues[id];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.head == queue.tail) {
+        return false;
+    }
+    *range = queue.tasks[queue.head++];
+    return true;
+}
+
+bool ThreadPool::steal(size_t id, Range* range) {
+    const size_t threads = _queues.size();
+    for (size_t k = 1; k < threads; k++) {
+        Queue& victim = *_queues[(id + k) % threads];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.head != victim.tail) {
+            *range = victim.tasks[--victim.tail];
+            return true;
+        }
+    }
+    return false;
+}
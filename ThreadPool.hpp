@@ -0,0 +1,82 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace NB {
+// Persistent pool of worker threads. parallelFor splits a range into
+// chunks that are dealt out to per-worker queues; a worker that runs dry
+// steals from the back of another worker's queue, so uneven chunks still
+// keep every thread busy. The calling thread takes part as worker 0.
+class ThreadPool {
+ public:
+    // Body of a parallel loop: [begin, end) and the id of the worker
+    // running it, in [0, threads()). A non-owning reference to a callable,
+    // so handing a lambda to parallelFor never allocates; the callable
+    // must outlive the call, which a temporary argument always does.
+    class RangeFn {
+     public:
+        template <typename F, typename = std::enable_if_t<
+                      !std::is_same_v<std::decay_t<F>, RangeFn>>>
+        RangeFn(const F& fn):  // NOLINT(runtime/explicit)
+        _object(&fn), _call([](const void* object, size_t begin,
+                               size_t end, size_t worker) {
+            (*static_cast<const F*>(object))(begin, end, worker);
+        }) {}
+
+        void operator()(size_t begin, size_t end, size_t worker) const {
+            _call(_object, begin, end, worker);
+        }
+
+     private:
+        const void* _object;
+        void (*_call)(const void*, size_t, size_t, size_t);
+    };
+
+    explicit ThreadPool(size_t threads);  // 0 picks the hardware count
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    size_t threads() const;
+
+    void parallelFor(size_t begin, size_t end, size_t grain,
+                     const RangeFn& body);
+
+ private:
+    using Range = std::pair<size_t, size_t>;
+
+    // The chunks of the current loop. The owner pops from head, thieves
+    // from tail; the vector keeps its capacity from loop to loop.
+    struct Queue {
+        std::mutex lock;
+        std::vector<Range> tasks;
+        size_t head = 0;
+        size_t tail = 0;
+    };
+
+    void workerLoop(size_t id);
+    void runTasks(size_t id);
+    bool popLocal(size_t id, Range* range);
+    bool steal(size_t id, Range* range);
+
+    std::vector<std::thread> _workers;
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const RangeFn* _body = nullptr;
+    size_t _generation = 0;
+    std::atomic<size_t> _pending{0};
+    bool _stop = false;
+};
+}  // namespace NB
@@ -0,0 +1,255 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <zlib.h>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "TrajectoryRecorder.hpp"
+using NB::BodyState;
+using NB::TrajectoryFormat;
+using NB::TrajectoryRecorder;
+
+static const char kMagic[8] = {'N', 'B', 'T', 'R', 'A', 'J', '\0', '\0'};
+static const uint32_t kVersion = 1;
+static const uint32_t kByteOrder = 0x01020304;
+
+namespace NB {
+TrajectoryFormat trajectoryFormatFor(const std::string& path) {
+    auto endsWith = [&](const std::string& suffix) {
+        return path.size() >= suffix.size() &&
+               path.compare(path.size() - suffix.size(), suffix.size(),
+                            suffix) == 0;
+    };
+    if (endsWith(".csv.gz")) {
+        return TrajectoryFormat::CsvGz;
+    }
+    if (endsWith(".csv")) {
+        return TrajectoryFormat::Csv;
+    }
+    return TrajectoryFormat::Binary;
+}
+}  // namespace NB
+
+TrajectoryRecorder::~TrajectoryRecorder() { close(); }
+
+void TrajectoryRecorder::setStride(uint64_t stride) {
+    _stride = stride > 0 ? stride : 1;
+}
+
+void TrajectoryRecorder::setBodies(const std::vector<uint32_t>& bodies) {
+    _requested = bodies;
+}
+
+void TrajectoryRecorder::setBuffers(size_t buffers) {
+    _bufferCount = buffers > 2 ? buffers : 2;
+}
+
+bool TrajectoryRecorder::open(const std::string& path,
+                              TrajectoryFormat format, size_t bodies,
+                              std::string* error) {
+    close();
+    _bodies = _requested;
+    if (_bodies.empty()) {
+        _bodies.resize(bodies);
+        for (size_t i = 0; i < bodies; i++) {
+            _bodies[i] = static_cast<uint32_t>(i);
+        }
+    }
+    for (uint32_t body : _bodies) {
+        if (body >= bodies) {
+            *error = "no body " + std::to_string(body) + " to record";
+            return false;
+        }
+    }
+
+    _format = format;
+    _failed = false;
+    if (format == TrajectoryFormat::CsvGz) {
+        _gz = gzopen(path.c_str(), "wb1");
+    } else {
+        _file = std::fopen(path.c_str(), "wb");
+    }
+    if (!_file && !_gz) {
+        *error = "cannot create " + path;
+        return false;
+    }
+
+    const size_t k = _bodies.size();
+    _ring.assign(_bufferCount, Frame());
+    for (Frame& frame : _ring) {
+        frame.data.resize(4 * k);
+    }
+    _head = _tail = _queued = 0;
+    _stop = false;
+    _frames = _stalls = 0;
+
+    if (format == TrajectoryFormat::Binary) {
+        uint64_t count = k;
+        writeBytes(kMagic, sizeof(kMagic));
+        writeBytes(reinterpret_cast<const char*>(&kVersion),
+                   sizeof(kVersion));
+        writeBytes(reinterpret_cast<const char*>(&kByteOrder),
+                   sizeof(kByteOrder));
+        writeBytes(reinterpret_cast<const char*>(&count), sizeof(count));
+        writeBytes(reinterpret_cast<const char*>(_bodies.data()),
+                   k * sizeof(uint32_t));
+    } else {
+        // Seven fields of at most 24 characters each per row.
+        _text.reserve(k * 7 * 25);
+        const char header[] = "step,time,body,x,y,vx,vy\n";
+        writeBytes(header, sizeof(header) - 1);
+    }
+
+    _writer = std::thread(&TrajectoryRecorder::writerLoop, this);
+    return true;
+}
+
+bool TrajectoryRecorder::isOpen() const { return _writer.joinable(); }
+
+void TrajectoryRecorder::record(const BodyState& state, double time,
+                                uint64_t step,
+                                const std::vector<uint32_t>* slots) {
+    if (!isOpen() || step % _stride != 0) {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_queued == _ring.size()) {
+            _stalls++;
+            _freed.wait(lock, [&] { return _queued < _ring.size(); });
+        }
+    }
+
+    // The frame at _head is not queued, so the writer leaves it alone.
+    Frame& frame = _ring[_head];
+    const size_t k = _bodies.size();
+    double* x = frame.data.data();
+    double* y = x + k;
+    double* vx = y + k;
+    double* vy = vx + k;
+    const double gone = std::numeric_limits<double>::quiet_NaN();
+    for (size_t j = 0; j < k; j++) {
+        uint32_t i = _bodies[j];
+        if (slots) {
+            i = i < slots->size() ? (*slots)[i] : NB::kNoSlot;
+        }
+        if (i >= state.size()) {
+            x[j] = y[j] = vx[j] = vy[j] = gone;
+            continue;
+        }
+        x[j] = state.x[i];
+        y[j] = state.y[i];
+        vx[j] = state.vx[i];
+        vy[j] = state.vy[i];
+    }
+    frame.time = time;
+    frame.step = step;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _head = (_head + 1) % _ring.size();
+        _queued++;
+        _frames++;
+    }
+    _filled.notify_one();
+}
+
+bool TrajectoryRecorder::close() {
+    if (!_writer.joinable()) {
+        return !_failed;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _filled.notify_one();
+    _writer.join();
+
+    if (_gz) {
+        if (gzclose(static_cast<gzFile>(_gz)) != Z_OK) {
+            _failed = true;
+        }
+        _gz = nullptr;
+    }
+    if (_file) {
+        if (std::fclose(_file) != 0) {
+            _failed = true;
+        }
+        _file = nullptr;
+    }
+    return !_failed;
+}
+
+uint64_t TrajectoryRecorder::framesRecorded() const { return _frames; }
+
+uint64_t TrajectoryRecorder::stalls() const { return _stalls; }
+
+void TrajectoryRecorder::writerLoop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _filled.wait(lock, [&] { return _queued > 0 || _stop; });
+        if (_queued == 0) {
+            return;
+        }
+        const Frame& frame = _ring[_tail];
+        lock.unlock();
+        writeFrame(frame);
+        lock.lock();
+        _tail = (_tail + 1) % _ring.size();
+        _queued--;
+        _freed.notify_one();
+    }
+}
+
+void TrajectoryRecorder::writeFrame(const Frame& frame) {
+    const size_t k = _bodies.size();
+    if (_format == TrajectoryFormat::Binary) {
+        writeBytes(reinterpret_cast<const char*>(&frame.time),
+                   sizeof(frame.time));
+        writeBytes(reinterpret_cast<const char*>(&frame.step),
+                   sizeof(frame.step));
+        writeBytes(reinterpret_cast<const char*>(frame.data.data()),
+                   frame.data.size() * sizeof(double));
+        return;
+    }
+
+    // Shortest round-trip formatting, so the CSV loses no precision.
+    char field[32];
+    auto append = [&](auto value, char separator) {
+        auto result = std::to_chars(field, field + sizeof(field), value);
+        _text.append(field, result.ptr);
+        _text.push_back(separator);
+    };
+    const double* data = frame.data.data();
+    _text.clear();
+    for (size_t j = 0; j < k; j++) {
+        append(frame.step, ',');
+        append(frame.time, ',');
+        append(_bodies[j], ',');
+        append(data[j], ',');
+        append(data[k + j], ',');
+        append(data[2 * k + j], ',');
+        append(data[3 * k + j], '\n');
+    }
+    writeBytes(_text.data(), _text.size());
+}
+
+void TrajectoryRecorder::writeBytes(const char* data, size_t size) {
+    if (_failed || size == 0) {
+        return;
+    }
+    if (_gz) {
+        if (gzwrite(static_cast<gzFile>(_gz), data,
+                    static_cast<unsigned>(size)) == 0) {
+            _failed = true;
+        }
+    } else if (std::fwrite(data, 1, size, _file) != size) {
+        _failed = true;
+    }
+}
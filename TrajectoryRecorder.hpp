@@ -0,0 +1,96 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BodyState.hpp"
+
+namespace NB {
+// Binary: "NBTRAJ\0\0", uint32 version, uint32 byte-order mark 0x01020304,
+//         uint64 body count k, k uint32 body indices, then per frame a
+//         double time, a uint64 step and the x, y, vx, vy arrays (k doubles
+//         each), all in native byte order.
+// Csv:    "step,time,body,x,y,vx,vy" with one row per body per frame.
+// CsvGz:  the same rows, gzip-compressed.
+enum class TrajectoryFormat { Binary, Csv, CsvGz };
+
+// Picks the format from the file name: .csv, .csv.gz, anything else binary.
+TrajectoryFormat trajectoryFormatFor(const std::string& path);
+
+// Records positions and velocities over a run. record() copies the chosen
+// bodies into one of a ring of preallocated frames and returns; a
+// background thread formats and writes full frames. The simulation only
+// waits when every frame in the ring is still queued for the writer.
+class TrajectoryRecorder {
+ public:
+    TrajectoryRecorder() = default;
+    TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+    ~TrajectoryRecorder();
+
+    // Set before open(). An empty body list records every body.
+    void setStride(uint64_t stride);  // record every stride-th step
+    void setBodies(const std::vector<uint32_t>& bodies);
+    void setBuffers(size_t buffers);  // frames in the ring, at least 2
+
+    // bodies is the size of the universe being recorded.
+    bool open(const std::string& path, TrajectoryFormat format,
+              size_t bodies, std::string* error);
+    bool isOpen() const;
+
+    // Records the state if step is a multiple of the stride. Body i is at
+    // (*slots)[i] in state, or at i without slots (see
+    // Universe::inputSlots). Bodies at kNoSlot, absorbed by collisions, are
+    // recorded as NaN, as are bodies past the end of state without slots.
+    void record(const BodyState& state, double time, uint64_t step,
+                const std::vector<uint32_t>* slots = nullptr);
+
+    // Writes out everything recorded and stops the writer. Returns false
+    // if any write failed.
+    bool close();
+
+    uint64_t framesRecorded() const;
+    uint64_t stalls() const;  // times record() had to wait for the writer
+
+ private:
+    struct Frame {
+        double time = 0.0;
+        uint64_t step = 0;
+        std::vector<double> data;  // x, y, vx, vy, each _bodies.size() long
+    };
+
+    void writerLoop();
+    void writeFrame(const Frame& frame);
+    void writeBytes(const char* data, size_t size);
+
+    uint64_t _stride = 1;
+    size_t _bufferCount = 8;
+    std::vector<uint32_t> _requested;
+    std::vector<uint32_t> _bodies;  // indices recorded, in output order
+    TrajectoryFormat _format = TrajectoryFormat::Binary;
+    std::FILE* _file = nullptr;
+    void* _gz = nullptr;  // gzFile
+    bool _failed = false;
+
+    std::vector<Frame> _ring;
+    size_t _head = 0;    // next frame to fill
+    size_t _tail = 0;    // next frame to write
+    size_t _queued = 0;  // frames filled and not yet written
+    bool _stop = false;
+    std::mutex _mutex;
+    std::condition_variable _filled;
+    std::condition_variable _freed;
+    std::thread _writer;
+    std::string _text;  // CSV formatting buffer, owned by the writer
+
+    uint64_t _frames = 0;
+    uint64_t _stalls = 0;
+};
+}  // namespace NB
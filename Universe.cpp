@@ -1,179 +1,952 @@
 // Copyright 2025 by Mohamed Bouchtout
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
-#include <fstream>
+#include <iterator>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 #include <cmath>
 #include <memory>
 #include <SFML/Graphics.hpp>
 #include "Universe.hpp"
 #include "CelestialBody.hpp"
+#include "DirectSum.hpp"
+#include "MappedFile.hpp"
+#include "Profiler.hpp"
+#include "Snapshot.hpp"
+#include "TextureCache.hpp"
 using NB::Universe;
 using NB::CelestialBody;
-
-static const double G = 6.67430e-11;
+using NB::ParseError;
+using NB::ParseException;
+using NB::UniverseReader;
+using NB::BodyRecord;
+using NB::MappedFile;
+using NB::SnapshotInfo;
+using NB::SnapshotReader;
+using NB::TextureCache;
+using NB::Metric;
+using NB::Phase;
+using NB::Profiler;
+using NB::FastMultipole;
+using NB::QuadTree;
+using NB::ScopedTimer;
 
 Universe::Universe(): _size(0), _radius(0.0),
-_fileName(""), _windowSize({800, 800}), _list() {}
+_fileName(""), _windowSize({800, 800}), _list(),
+_state(std::make_unique<BodyState>()) {}
+
+Universe::Universe(const std::string& filename): _size(0), _radius(0.0),
+_fileName(filename), _windowSize({800, 800}),
+_state(std::make_unique<BodyState>()) {
+    ParseError error;
+    if (!loadFile(filename, &error)) {
+        throw ParseException(error);
+    }
+}
+
+Universe::~Universe() { clearList(); }
+
+size_t Universe::size() const { return _size; }
+
+double Universe::radius() const { return _radius; }
+
+const std::vector<std::shared_ptr<NB::CelestialBody>>&
+Universe::list() const { return _list; }
+
+const NB::BodyState& Universe::state() const { return *_state; }
+
+const std::vector<uint32_t>& Universe::slots() const { return _slot; }
+
+const std::vector<uint32_t>& Universe::inputSlots() const {
+    return _inputSlot;
+}
+
+NB::Solver Universe::solver() const { return _solver; }
+
+double Universe::theta() const { return _theta; }
+
+int Universe::fmmOrder() const { return _fmm.order(); }
+
+NB::Precision Universe::precision() const { return _precision; }
+
+size_t Universe::threads() const { return _pool ? _pool->threads() : 1; }
+
+bool Universe::simd() const { return _simd; }
+
+NB::SimdLevel Universe::simdLevel() const { return _simdLevel; }
+
+double Universe::softening() const { return _softening; }
+
+bool Universe::collisions() const { return _collisions; }
+
+double Universe::collisionDensity() const { return _collisionDensity; }
+
+size_t Universe::merges() const { return _merges; }
 
-Universe::Universe(const std::string& filename) {
-    std::ifstream file(filename);
-    std::string line;
+NB::Integrator Universe::integrator() const { return _integrator; }
+
+const NB::BlockStepper& Universe::blockStepper() const { return _block; }
+
+size_t Universe::forceEvaluations() const { return _forceEvaluations; }
+
+bool Universe::batchRendering() const { return _batch; }
+
+size_t Universe::reorderInterval() const { return _reorderInterval; }
+
+size_t Universe::diagnosticsInterval() const { return _diagnosticsInterval; }
+
+const NB::Conservation& Universe::conservation() const {
+    return _conservation;
+}
+
+bool Universe::measured() const { return _measured; }
+
+const NB::ParseError& Universe::parseError() const { return _parseError; }
+
+void Universe::setSize(size_t size) { _size = size; }
+
+void Universe::setRadius(double radius) { _radius = radius; }
+
+// The body's values move into the state arrays and the body becomes a
+// view onto its slot.
+void Universe::addToList(std::shared_ptr<NB::CelestialBody> ptr) {
+    sf::Vector2<double> position = ptr->precisePosition();
+    sf::Vector2<double> velocity = ptr->preciseVelocity();
+    size_t index = _state->push(ptr->preciseMass(), position.x, position.y,
+                                velocity.x, velocity.y);
+    ptr->bind(_state.get(), index);
+    _list.push_back(ptr);
+    _slot.push_back(static_cast<uint32_t>(index));
+    _inputSlot.push_back(static_cast<uint32_t>(index));
+    _rendererDirty = true;
+}
+
+bool Universe::loadFile(const std::string& filename, ParseError* error) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        _parseError = {0, file.error()};
+        *error = _parseError;
+        return false;
+    }
     _fileName = filename;
-    _windowSize = {800, 800};
+    return load(file.data(), error);
+}
 
-    if (!file.is_open()) {
-        std::cout << "file did not open.\n";
-        exit(1);
+// Replaces the current bodies. On failure the universe is left empty.
+bool Universe::load(std::string_view text, ParseError* error) {
+    clearList();
+    _size = 0;
+    _parseError = {};
+
+    auto fail = [&](const ParseError& reason) {
+        clearList();
+        _size = 0;
+        _parseError = reason;
+        *error = reason;
+        return false;
+    };
+
+    UniverseReader reader(text);
+    size_t count = 0;
+    double radius = 0.0;
+    if (!reader.readHeader(&count, &radius)) {
+        return fail(reader.error());
     }
+    _radius = radius;
+
+    // Every body line takes at least 11 characters, which bounds the
+    // reservation when the count in the header is wrong.
+    _state->reserve(std::min(count, text.size() / 11 + 1));
+    _list.reserve(std::min(count, text.size() / 11 + 1));
+    const float scale = (800 / 2) / radius;
+
+    BodyRecord record;
+    while (reader.next(&record)) {
+        if (!addRecord(record, scale, reader.line(), error)) {
+            return fail(*error);
+        }
+    }
+    if (!reader.done()) {
+        return fail(reader.error());
+    }
+    _size = count;
+    return true;
+}
 
-    if (std::getline(file, line)) {
-        std::istringstream iss(line);
-        iss >> _size;
-    } else {
-        std::cout << "Error: File is empty or missing size value.\n";
-        exit(1);
+// Creates a body from a parsed line or snapshot entry; line is only used
+// to report an image that cannot be loaded.
+bool Universe::addRecord(const BodyRecord& record, float scale, size_t line,
+                         ParseError* error) {
+    auto obj = std::make_shared<NB::CelestialBody>();
+    obj->setPreciseMass(record.mass);
+    obj->setPrecisePosition({record.x, record.y});
+    obj->setPreciseVelocity({record.vx, record.vy});
+    obj->setFileName(std::string(record.image));
+    if (CelestialBody::loadTextures()) {
+        auto texture = TextureCache::global().get(obj->filename());
+        if (!texture) {
+            *error = {line, "cannot load image '" + obj->filename() + "'"};
+            return false;
+        }
+        obj->setTexture(texture);
+        sf::Sprite sprite;
+        sprite.setTexture(*texture);
+        obj->setSprite(sprite);
     }
+    addToList(obj);
+    obj->updateSpritePosition(scale);
+    return true;
+}
 
-    if (std::getline(file, line)) {
-        std::istringstream iss(line);
-        iss >> _radius;
-    } else {
-        std::cout << "Error: Missing radius value.\n";
-        exit(1);
+bool Universe::saveSnapshot(const std::string& path, const SnapshotInfo& info,
+                            std::string* error) const {
+    std::vector<std::string_view> names;
+    std::vector<uint32_t> images(_list.size());
+    std::unordered_map<std::string_view, uint32_t> index;
+    for (size_t i = 0; i < _list.size(); i++) {
+        std::string_view name = _list[i]->filename();
+        auto [it, added] = index.emplace(name, names.size());
+        if (added) {
+            names.push_back(name);
+        }
+        images[i] = it->second;
+    }
+    // Snapshots hold the bodies in list order, whatever the arrays' order.
+    bool inOrder = true;
+    for (size_t i = 0; i < _slot.size(); i++) {
+        inOrder = inOrder && _slot[i] == i;
     }
+    if (inOrder) {
+        return writeSnapshot(path, *_state, _radius, names, images, info,
+                             error);
+    }
+    BodyState ordered;
+    ordered.reserve(_list.size());
+    for (uint32_t i : _slot) {
+        ordered.push(_state->mass[i], _state->x[i], _state->y[i],
+                     _state->vx[i], _state->vy[i]);
+    }
+    return writeSnapshot(path, ordered, _radius, names, images, info, error);
+}
 
-    float scale = (_windowSize.x / 2) / _radius;
+// Replaces the current bodies. On failure the universe is left empty.
+bool Universe::loadSnapshot(const std::string& path, SnapshotInfo* info,
+                            ParseError* error) {
+    clearList();
+    _size = 0;
+    _parseError = {};
+
+    SnapshotReader reader;
+    if (!reader.open(path, error)) {
+        _parseError = *error;
+        return false;
+    }
+    _radius = reader.radius();
+    _fileName = path;
+    _state->reserve(reader.size());
+    _list.reserve(reader.size());
+    const float scale = (800 / 2) / _radius;
+
+    BodyRecord record;
+    for (size_t i = 0; i < reader.size(); i++) {
+        reader.body(i, &record);
+        if (!addRecord(record, scale, 0, error)) {
+            clearList();
+            _parseError = *error;
+            return false;
+        }
+    }
+    _size = reader.size();
+    *info = reader.info();
+    return true;
+}
 
-    for (size_t i = 0; i < _size; i++) {
-        if (std::getline(file, line)) {
-            std::istringstream iss(line);
-            float posX, posY, velX, velY, mass;
-            std::string fileName;
+void Universe::setSolver(Solver solver) { _solver = solver; }
 
-            if (!(iss >> posX >> posY >> velX >> velY >> mass >> fileName)) {
-                std::cout << "Error parsing line: " << line << "\n";
-                exit(1);
-            }
+void Universe::setTheta(double theta) { _theta = theta; }
+
+void Universe::setFmmOrder(int order) { _fmm.setOrder(order); }
 
-            sf::Vector2f position = sf::Vector2f(posX, posY);
-            sf::Vector2f velocity = sf::Vector2f(velX, velY);
+void Universe::setPrecision(Precision precision) { _precision = precision; }
 
-            auto obj = std::make_shared<NB::CelestialBody>
-            (mass, position, velocity, fileName);
+void Universe::setThreads(size_t threads) {
+    if (threads == 1) {
+        _pool.reset();
+    } else {
+        _pool = std::make_unique<ThreadPool>(threads);
+    }
+}
 
-            obj->updateSpritePosition(scale);
+void Universe::setSimd(bool enabled) { _simd = enabled; }
 
-            _list.push_back(obj);
+void Universe::setSimdLevel(SimdLevel level) { _simdLevel = level; }
 
-        } else {
-            std::cout << "Error: Missing data\n";
-            exit(1);
-        }
-    }
+void Universe::setSoftening(double eps) {
+    _softening = eps;
+    _block.setSoftening(eps);
+    _forcesCurrent = false;
 }
 
-size_t Universe::size() const { return _size; }
+void Universe::setCollisions(bool enabled) { _collisions = enabled; }
 
-double Universe::radius() const { return _radius; }
+void Universe::setCollisionDensity(double density) {
+    _collisionDensity = density;
+}
 
-const std::vector<std::shared_ptr<NB::CelestialBody>>&
-Universe::list() const { return _list; }
+void Universe::setIntegrator(Integrator integrator) {
+    _integrator = integrator;
+    _block.reset();
+}
 
-void Universe::setSize(size_t size) { _size = size; }
+void Universe::setBlockLevels(int levels) { _block.setMaxLevel(levels); }
 
-void Universe::setRadius(double radius) { _radius = radius; }
+void Universe::setBlockAccuracy(double eta) { _block.setAccuracy(eta); }
 
-void Universe::addToList(std::shared_ptr<NB::CelestialBody> ptr) {
-    _list.push_back(ptr);
+void Universe::setBatchRendering(bool enabled) { _batch = enabled; }
+
+void Universe::setBodyScale(float scale) { _renderer.setBodyScale(scale); }
+
+void Universe::setReorderInterval(size_t steps) {
+    _reorderInterval = steps;
+    _sinceReorder = 0;
 }
 
-void Universe::clearList() { _list.clear(); }
+void Universe::setDiagnosticsInterval(size_t steps) {
+    _diagnosticsInterval = steps;
+    _sinceDiagnostics = 0;
+}
+
+void Universe::clearList() {
+    for (const auto& obj : _list) {
+        obj->unbind();
+    }
+    _list.clear();
+    _slot.clear();
+    _inputSlot.clear();
+    _rendererDirty = true;
+    if (_state) {
+        _state->clear();
+    }
+}
 
 const CelestialBody& Universe::operator[](size_t i) const {
     return *_list[i];
 }
 
 void Universe::step(double dt) {
-    float scale = (_windowSize.x / 2) / _radius;
-    std::vector<sf::Vector2<double>> forces(_size);
-    std::vector<sf::Vector2<double>> newPositions(_size);
-    std::vector<sf::Vector2<double>> newVelocities(_size);
-
-    for (size_t i = 0; i < _size; i++) {
-        for (size_t j = 0; j < _size; j++) {
-            if (i != j) {
-                sf::Vector2f diff = _list[j]->position() - _list[i]->position();
-                double distanceSquared = diff.x * diff.x + diff.y * diff.y;
-                double distance = std::sqrt(distanceSquared);
-                double forceMagnitude = G * _list[i]->mass()
-                * _list[j]->mass() / distanceSquared;
-
-                sf::Vector2<double> direction = sf::Vector2<double>
-                (diff.x / distance, diff.y / distance);
-
-                sf::Vector2<double> force = sf::Vector2<double>
-                (direction.x * forceMagnitude, direction.y * forceMagnitude);
-                forces[i] += force;
+    ScopedTimer timer(Phase::Step);
+    Profiler::count(Metric::Steps);
+    _measured = _diagnosticsInterval > 0 &&
+        ++_sinceDiagnostics >= _diagnosticsInterval;
+    switch (_integrator) {
+    case Integrator::Leapfrog:
+        stepKickDrift<NB::LeapfrogPolicy>(dt, _measured);
+        break;
+    case Integrator::Yoshida4:
+        stepYoshida4(dt);
+        break;
+    case Integrator::RK4:
+        stepRK4(dt);
+        break;
+    case Integrator::Block:
+        stepBlock(dt);
+        break;
+    case Integrator::Euler:
+    default:
+        stepKickDrift<NB::EulerPolicy>(dt);
+        break;
+    }
+    if (_collisions) {
+        collide();
+    }
+    if (_reorderInterval > 0 && ++_sinceReorder >= _reorderInterval) {
+        reorder();
+        _sinceReorder = 0;
+    }
+    if (_measured) {
+        measureConservation();
+        _sinceDiagnostics = 0;
+    }
+}
+
+// Semi-implicit Euler (v += a(x) dt, then x += v dt) and kick-drift-kick
+// leapfrog. Leapfrog's closing kick evaluates forces at the new positions,
+// which the opening kick of the next step reuses; with potential set, that
+// pass also sums the potential for measureConservation().
+template <typename Policy>
+void Universe::stepKickDrift(double dt, bool potential) {
+    ensureForces();
+    kickDrift(Policy::kOpen * dt, dt);
+    if constexpr (Policy::kClose != 0.0) {
+        _wantPotential = potential;
+        computeForces();
+        _wantPotential = false;
+        kick(Policy::kClose * dt);
+        _forcesCurrent = true;
+        _forceRevision = _state->revision;
+    } else {
+        _forcesCurrent = false;
+    }
+}
+
+// Yoshida's fourth-order composition of three leapfrog substeps. Only the
+// last one ends at the step's positions, so only it sums the potential.
+void Universe::stepYoshida4(double dt) {
+    const double cbrt2 = std::cbrt(2.0);
+    const double w1 = 1.0 / (2.0 - cbrt2);
+    const double w0 = -cbrt2 / (2.0 - cbrt2);
+    stepKickDrift<NB::LeapfrogPolicy>(w1 * dt);
+    stepKickDrift<NB::LeapfrogPolicy>(w0 * dt);
+    stepKickDrift<NB::LeapfrogPolicy>(w1 * dt, _measured);
+}
+
+void Universe::stepRK4(double dt) {
+    BodyState& st = *_state;
+    const size_t n = st.size();
+    _rkStart.x.assign(st.x.begin(), st.x.end());
+    _rkStart.y.assign(st.y.begin(), st.y.end());
+    _rkStart.vx.assign(st.vx.begin(), st.vx.end());
+    _rkStart.vy.assign(st.vy.begin(), st.vy.end());
+    _rkSum.x.assign(n, 0.0);
+    _rkSum.y.assign(n, 0.0);
+    _rkSum.vx.assign(n, 0.0);
+    _rkSum.vy.assign(n, 0.0);
+
+    // Stage k evaluates the derivative at the state in st, adds it to the
+    // running sum with weight w, and moves st to start + c * dt * k.
+    const double weight[4] = {1.0, 2.0, 2.0, 1.0};
+    const double next[4] = {dt / 2, dt / 2, dt, 0.0};
+    for (int k = 0; k < 4; k++) {
+        if (k == 0) {
+            ensureForces();
+        } else {
+            computeForces();
+        }
+        const double w = weight[k];
+        const double c = next[k];
+        forEachBody(4096, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                double kvx = st.vx[i];
+                double kvy = st.vy[i];
+                _rkSum.x[i] += w * kvx;
+                _rkSum.y[i] += w * kvy;
+                _rkSum.vx[i] += w * st.ax[i];
+                _rkSum.vy[i] += w * st.ay[i];
+                if (c > 0) {
+                    st.x[i] = _rkStart.x[i] + c * kvx;
+                    st.y[i] = _rkStart.y[i] + c * kvy;
+                    st.vx[i] = _rkStart.vx[i] + c * st.ax[i];
+                    st.vy[i] = _rkStart.vy[i] + c * st.ay[i];
+                }
             }
+        });
+    }
+
+    forEachBody(4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            st.x[i] = _rkStart.x[i] + dt / 6 * _rkSum.x[i];
+            st.y[i] = _rkStart.y[i] + dt / 6 * _rkSum.y[i];
+            st.vx[i] = _rkStart.vx[i] + dt / 6 * _rkSum.vx[i];
+            st.vy[i] = _rkStart.vy[i] + dt / 6 * _rkSum.vy[i];
         }
+    });
+    _forcesCurrent = false;
+}
 
-        double mass = _list[i]->mass();
-        _list[i]->setForce(forces[i]);
-        _list[i]->setAcceleration(forces[i] / mass);
+// Every body ends the block synchronized with fresh accelerations, which
+// a following leapfrog step may reuse.
+void Universe::stepBlock(double dt) {
+    _forceEvaluations += _block.step(*_state, dt, _pool.get());
+    _forcesCurrent = true;
+    _forceRevision = _state->revision;
+    _potentialCurrent = false;
+}
+
+void Universe::ensureForces() {
+    if (!_forcesCurrent || _forceRevision != _state->revision) {
+        computeForces();
     }
+}
 
-    for (size_t i = 0; i < _size; i++) {
-        sf::Vector2<double> velocity(_list[i]->velocity());
-        sf::Vector2<double> position(_list[i]->position());
+void Universe::kick(double h) {
+    ScopedTimer timer(Phase::Integrate);
+    BodyState& st = *_state;
+    forEachBody(4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            st.vx[i] += st.ax[i] * h;
+            st.vy[i] += st.ay[i] * h;
+        }
+    });
+}
 
-        sf::Vector2<double> newVelocity = velocity
-        + _list[i]->acceleration() * dt;
+// v += a * kick, then x += v * drift, in one pass over the bodies.
+void Universe::kickDrift(double kick, double drift) {
+    ScopedTimer timer(Phase::Integrate);
+    BodyState& st = *_state;
+    forEachBody(4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            st.vx[i] += st.ax[i] * kick;
+            st.vy[i] += st.ay[i] * kick;
+            st.x[i] += st.vx[i] * drift;
+            st.y[i] += st.vy[i] * drift;
+        }
+    });
+}
 
-        sf::Vector2<double> newPosition = position + newVelocity * dt;
+// Work handed to forEachBody must not depend on which thread runs which
+// part of the range, so results do not change with scheduling.
+void Universe::forEachBody(size_t grain, const ThreadPool::RangeFn& body) {
+    const size_t n = _state->size();
+    if (_pool) {
+        _pool->parallelFor(0, n, grain, body);
+    } else {
+        body(0, n, 0);
+    }
+}
 
-        newVelocities[i] = newVelocity;
-        newPositions[i] = newPosition;
+void Universe::computeForces() {
+    ScopedTimer timer(Phase::Forces);
+    _forceEvaluations += _state->size();
+    _potentialCurrent = _wantPotential && sumsPotential();
+    switch (_solver) {
+    case Solver::BarnesHut:
+        treeForces();
+        break;
+    case Solver::Fmm:
+        fmmForces();
+        break;
+    case Solver::Direct:
+    default:
+        directForces();
+        break;
     }
+}
 
-    for (size_t i = 0; i < _size; i++) {
-        sf::Vector2f velocity(newVelocities[i]);
-        sf::Vector2f position(newPositions[i]);
+// The kernel variant is chosen here, once per evaluation.
+void Universe::directForces() {
+    BodyState& st = *_state;
+    const size_t n = st.size();
+    const double soft2 = _softening * _softening;
+    Profiler::count(Metric::Interactions, n > 0 ? n * (n - 1) : 0);
+
+    if (_simd) {
+        const double extent = stateExtent(st);
+        double* ax = st.ax.data();
+        double* ay = st.ay.data();
+        forEachBody(16, [&](size_t begin, size_t end, size_t) {
+            simdAccelerations(st, begin, end, extent, soft2, _simdLevel,
+                              ax, ay);
+        });
+        return;
+    }
 
-        _list[i]->setVelocity(velocity);
-        _list[i]->setPosition(position);
-        _list[i]->updateSpritePosition(scale);
+    const bool softened = soft2 > 0;
+    double* ax = st.ax.data();
+    double* ay = st.ay.data();
+    if (_wantPotential && _precision == Precision::Float) {
+        softened ? directSum<float, true, true>(ax, ay)
+                 : directSum<float, false, true>(ax, ay);
+    } else if (_wantPotential) {
+        softened ? directSum<double, true, true>(ax, ay)
+                 : directSum<double, false, true>(ax, ay);
+    } else if (_precision == Precision::Float) {
+        softened ? directSum<float, true, false>(ax, ay)
+                 : directSum<float, false, false>(ax, ay);
+    } else {
+        softened ? directSum<double, true, false>(ax, ay)
+                 : directSum<double, false, false>(ax, ay);
     }
 }
 
-void Universe::draw(sf::RenderTarget& window, sf::RenderStates states) const {
-    for (const auto& obj : _list) {
-        window.draw(obj->sprite(), states);
+// Each pair is evaluated once by the symmetric tile kernel. Serially the
+// tiles scatter straight into ax/ay; with a pool the tile rows are split
+// into one fixed slice per thread, each with its own accumulator, and the
+// slices are summed in order afterwards. The split only depends on the
+// thread count, so a given count always reproduces the same bits. With
+// Potential the pair potentials are summed the same way into _potential.
+template <typename Real, bool Softened, bool Potential>
+void Universe::directSum(double* ax, double* ay) {
+    BodyState& st = *_state;
+    const size_t n = st.size();
+    const size_t rows = directTileRows(n);
+    NB::PairConstants constants;
+    constants.softening2 = _softening * _softening;
+    if constexpr (std::is_same_v<Real, float>) {
+        constants.extent = stateExtent(st);
     }
+
+    if (!_pool) {
+        std::fill(ax, ax + n, 0.0);
+        std::fill(ay, ay + n, 0.0);
+        double potential = 0.0;
+        for (size_t row = 0; row < rows; row++) {
+            directTileRow<Real, Softened, Potential>(st, row, constants,
+                                                     ax, ay, &potential);
+        }
+        if constexpr (Potential) {
+            _potential = potential;
+        }
+        return;
+    }
+
+    const size_t slices = _pool->threads();
+    _sliceAx.resize(slices);
+    _sliceAy.resize(slices);
+    _slicePotential.assign(slices, 0.0);
+
+    _pool->parallelFor(0, slices, 1, [&](size_t begin, size_t end, size_t) {
+        for (size_t s = begin; s < end; s++) {
+            _sliceAx[s].assign(n, 0.0);
+            _sliceAy[s].assign(n, 0.0);
+            for (size_t row = 0; row < rows; row++) {
+                if (directRowInSlice(row, s, slices)) {
+                    directTileRow<Real, Softened, Potential>(
+                        st, row, constants, _sliceAx[s].data(),
+                        _sliceAy[s].data(), &_slicePotential[s]);
+                }
+            }
+        }
+    });
+    if constexpr (Potential) {
+        _potential = 0.0;
+        for (size_t s = 0; s < slices; s++) {
+            _potential += _slicePotential[s];
+        }
+    }
+
+    forEachBody(4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            double sx = 0.0;
+            double sy = 0.0;
+            for (size_t s = 0; s < slices; s++) {
+                sx += _sliceAx[s][i];
+                sy += _sliceAy[s][i];
+            }
+            ax[i] = sx;
+            ay[i] = sy;
+        }
+    });
 }
 
-namespace NB {
-std::istream& operator>>(std::istream& is, Universe& uni) {
-    float size;
-    double radius;
+void Universe::treeForces() {
+    {
+        ScopedTimer timer(Phase::TreeBuild);
+        _tree.build(*_state);
+    }
+    const bool softened = _softening > 0;
+    double* ax = _state->ax.data();
+    double* ay = _state->ay.data();
+    if (_wantPotential) {
+        softened ? treeWalk<true, true>(ax, ay)
+                 : treeWalk<false, true>(ax, ay);
+    } else {
+        softened ? treeWalk<true, false>(ax, ay)
+                 : treeWalk<false, false>(ax, ay);
+    }
+}
 
-    is >> size >> radius;
-    uni.setSize(size);
-    uni.setRadius(radius);
-    uni.clearList();
+// With Potential every body's potential is kept, and the energy is summed
+// in body order afterwards so it does not depend on the scheduling.
+template <bool Softened, bool Potential>
+void Universe::treeWalk(double* ax, double* ay) {
+    BodyState& st = *_state;
+    const double soft2 = _softening * _softening;
+    if constexpr (Potential) {
+        _phi.resize(st.size());
+    }
+    forEachBody(64, [&](size_t begin, size_t end, size_t) {
+        QuadTree::Walk total;
+        for (size_t i = begin; i < end; i++) {
+            QuadTree::Walk walk = _tree.acceleration<Softened>(
+                st, i, _theta, soft2, &ax[i], &ay[i],
+                Potential ? &_phi[i] : nullptr);
+            total.nodes += walk.nodes;
+            total.interactions += walk.interactions;
+        }
+        Profiler::count(Metric::NodesVisited, total.nodes);
+        Profiler::count(Metric::Interactions, total.interactions);
+    });
+    if constexpr (Potential) {
+        double potential = 0.0;
+        for (size_t i = 0; i < st.size(); i++) {
+            potential += st.mass[i] * _phi[i];
+        }
+        _potential = 0.5 * potential;
+    }
+}
 
-    float scale = (800 / 2) / radius;
+// The kernels that can sum the potential with the forces.
+bool Universe::sumsPotential() const {
+    return (_solver == Solver::Direct && !_simd) ||
+        _solver == Solver::BarnesHut;
+}
 
-    for (size_t i = 0; i < uni.size(); i++) {
-        auto obj = std::make_shared<NB::CelestialBody>();
+// Leaves ax/ay alone: block steps keep their own accelerations, and the
+// SIMD and FMM forces must not change with the diagnostics interval.
+void Universe::potentialPass() {
+    BodyState& st = *_state;
+    _scratchAx.resize(st.size());
+    _scratchAy.resize(st.size());
+    double* ax = _scratchAx.data();
+    double* ay = _scratchAy.data();
+    const bool softened = _softening > 0;
+    if (_solver == Solver::Direct || _integrator == Integrator::Block) {
+        softened ? directSum<double, true, true>(ax, ay)
+                 : directSum<double, false, true>(ax, ay);
+    } else {
+        {
+            ScopedTimer timer(Phase::TreeBuild);
+            _tree.build(st);
+        }
+        softened ? treeWalk<true, true>(ax, ay)
+                 : treeWalk<false, true>(ax, ay);
+    }
+}
+
+// The potential is taken from the last force pass if it was summed there
+// at these positions. Otherwise, outside block steps, the forces are
+// computed now with the potential; the next step finds them current and
+// does not compute them again.
+const NB::Conservation& Universe::measureConservation() {
+    ScopedTimer timer(Phase::Diagnostics);
+    BodyState& st = *_state;
+    const bool current = _forcesCurrent && _forceRevision == st.revision;
+    if (!(current && _potentialCurrent)) {
+        if (_integrator != Integrator::Block && sumsPotential()) {
+            _wantPotential = true;
+            computeForces();
+            _wantPotential = false;
+            _forcesCurrent = true;
+            _forceRevision = st.revision;
+        } else {
+            potentialPass();
+        }
+    }
+    measureMotion(st, &_conservation);
+    _conservation.potential = _potential;
+    _conservation.merges = _merges;
+    return _conservation;
+}
+
+// Overlapping pairs join groups (union-find, each group rooted at its
+// lowest slot). Every group collapses into its root slot with the total
+// mass at the centre of mass and the total momentum, and the arrays are
+// compacted in order. The surviving body object, and so the image, is the
+// group's heaviest member; it keeps its list place, and the others are
+// detached from the universe.
+void Universe::collide() {
+    ScopedTimer timer(Phase::Collisions);
+    BodyState& st = *_state;
+    const auto& pairs = _grid.overlaps(st, _collisionDensity);
+    if (pairs.empty()) {
+        return;
+    }
+
+    const size_t n = st.size();
+    _group.resize(n);
+    _survivor.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        _group[i] = static_cast<uint32_t>(i);
+        _survivor[i] = static_cast<uint32_t>(i);
+    }
+    auto find = [&](uint32_t i) {
+        while (_group[i] != i) {
+            _group[i] = _group[_group[i]];
+            i = _group[i];
+        }
+        return i;
+    };
+    for (const auto& [a, b] : pairs) {
+        uint32_t ra = find(a);
+        uint32_t rb = find(b);
+        if (ra != rb) {
+            _group[std::max(ra, rb)] = std::min(ra, rb);
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint32_t root = find(static_cast<uint32_t>(i));
+        _group[i] = root;
+        if (st.mass[i] > st.mass[_survivor[root]]) {
+            _survivor[root] = static_cast<uint32_t>(i);
+        }
+    }
+
+    _bodyOf.resize(n);
+    for (size_t p = 0; p < n; p++) {
+        _bodyOf[_slot[p]] = static_cast<uint32_t>(p);
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (_survivor[_group[i]] != i) {
+            _list[_bodyOf[i]]->unbind();
+        }
+    }
 
-        is >> *obj;
+    // Roots come before their members, so each merge reads an untouched
+    // member slot and accumulates into the root.
+    for (size_t i = 0; i < n; i++) {
+        const uint32_t root = _group[i];
+        if (root == i) {
+            continue;
+        }
+        double m = st.mass[root] + st.mass[i];
+        st.x[root] = (st.mass[root] * st.x[root] + st.mass[i] * st.x[i]) / m;
+        st.y[root] = (st.mass[root] * st.y[root] + st.mass[i] * st.y[i]) / m;
+        st.vx[root] = (st.mass[root] * st.vx[root]
+                       + st.mass[i] * st.vx[i]) / m;
+        st.vy[root] = (st.mass[root] * st.vy[root]
+                       + st.mass[i] * st.vy[i]) / m;
+        st.mass[root] = m;
+    }
+
+    _newSlot.resize(n);
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (_group[i] != i) {
+            continue;
+        }
+        st.x[kept] = st.x[i];
+        st.y[kept] = st.y[i];
+        st.vx[kept] = st.vx[i];
+        st.vy[kept] = st.vy[i];
+        st.ax[kept] = st.ax[i];
+        st.ay[kept] = st.ay[i];
+        st.mass[kept] = st.mass[i];
+        _newSlot[i] = static_cast<uint32_t>(kept);
+        kept++;
+    }
+    st.resize(kept);
+
+    // Survivors keep their places in the list and absorbed bodies drop out,
+    // so the bodies left stay in the order they were in.
+    size_t out = 0;
+    for (size_t p = 0; p < n; p++) {
+        const uint32_t i = _slot[p];
+        const uint32_t root = _group[i];
+        if (_survivor[root] != i) {
+            continue;
+        }
+        _list[out] = _list[p];
+        _slot[out] = _newSlot[root];
+        _list[out]->bind(&st, _slot[out]);
+        out++;
+    }
+    _list.resize(kept);
+    _slot.resize(kept);
+    for (uint32_t& slot : _inputSlot) {
+        if (slot == kNoSlot) {
+            continue;
+        }
+        const uint32_t root = _group[slot];
+        slot = _survivor[root] == slot ? _newSlot[root] : kNoSlot;
+    }
+
+    Profiler::count(Metric::Merges, n - kept);
+    _merges += n - kept;
+    _size = kept;
+    _forcesCurrent = false;
+    _block.reset();
+    _rendererDirty = true;
+}
+
+// The arrays are permuted through a second set that keeps its capacity;
+// accelerations move with their bodies, so they stay current.
+void Universe::reorder() {
+    ScopedTimer timer(Phase::Reorder);
+    BodyState& st = *_state;
+    const size_t n = st.size();
+    hilbertOrder(st, &_curveKeys, &_curveOrder);
+
+    _reordered.resize(n);
+    _newSlot.resize(n);
+    for (size_t k = 0; k < n; k++) {
+        const uint32_t i = _curveOrder[k];
+        _reordered.x[k] = st.x[i];
+        _reordered.y[k] = st.y[i];
+        _reordered.vx[k] = st.vx[i];
+        _reordered.vy[k] = st.vy[i];
+        _reordered.ax[k] = st.ax[i];
+        _reordered.ay[k] = st.ay[i];
+        _reordered.mass[k] = st.mass[i];
+        _newSlot[i] = static_cast<uint32_t>(k);
+    }
+    st.x.swap(_reordered.x);
+    st.y.swap(_reordered.y);
+    st.vx.swap(_reordered.vx);
+    st.vy.swap(_reordered.vy);
+    st.ax.swap(_reordered.ax);
+    st.ay.swap(_reordered.ay);
+    st.mass.swap(_reordered.mass);
+
+    for (size_t p = 0; p < _list.size(); p++) {
+        _slot[p] = _newSlot[_slot[p]];
+        _list[p]->bind(&st, _slot[p]);
+    }
+    for (uint32_t& slot : _inputSlot) {
+        if (slot != kNoSlot) {
+            slot = _newSlot[slot];
+        }
+    }
+    const bool current = _forcesCurrent && _forceRevision == st.revision;
+    st.revision++;
+    if (current) {
+        _forceRevision = st.revision;
+    }
+}
+
+// The FMM runs on one thread; its work is linear in the body count.
+void Universe::fmmForces() {
+    FastMultipole::Walk walk =
+        _fmm.evaluate(*_state, _theta, _softening * _softening);
+    Profiler::count(Metric::NodesVisited, walk.cellPairs);
+    Profiler::count(Metric::Interactions,
+                    walk.interactions + walk.translations);
+}
+
+float Universe::scale() const { return (_windowSize.x / 2) / _radius; }
+
+// Sprites are only a render concern, so they are brought up to date with
+// the physics state right before drawing rather than on every step.
+void Universe::syncSprites() const {
+    ScopedTimer timer(Phase::Sprites);
+    float scale = this->scale();
+    for (const auto& obj : _list) {
         obj->updateSpritePosition(scale);
-        uni.addToList(obj);
     }
+}
 
+void Universe::draw(sf::RenderTarget& window, sf::RenderStates states) const {
+    if (_batch) {
+        if (_rendererDirty) {
+            _renderer.rebuild(_list);
+            _rendererDirty = false;
+        }
+        _renderer.update(*_state, scale(), &_slot);
+        window.draw(_renderer, states);
+        return;
+    }
+
+    syncSprites();
+    for (const auto& obj : _list) {
+        window.draw(obj->sprite(), states);
+    }
+}
+
+namespace NB {
+// Consumes the rest of the stream: the reader needs the whole description
+// in one buffer. On a malformed description failbit is set and the reason
+// is available from uni.parseError().
+std::istream& operator>>(std::istream& is, Universe& uni) {
+    std::string text(std::istreambuf_iterator<char>(is), {});
+    ParseError error;
+    if (!uni.load(text, &error)) {
+        is.setstate(std::ios::failbit);
+    }
     return is;
 }
 
@@ -0,0 +1,136 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <charconv>
+#include <string>
+#include <string_view>
+#include "UniverseParser.hpp"
+using NB::ParseError;
+using NB::ParseException;
+using NB::UniverseReader;
+
+std::string ParseError::describe() const {
+    if (line == 0) {
+        return message;
+    }
+    return "line " + std::to_string(line) + ": " + message;
+}
+
+ParseException::ParseException(const ParseError& error):
+std::runtime_error(error.describe()), _error(error) {}
+
+const ParseError& ParseException::error() const { return _error; }
+
+UniverseReader::UniverseReader(std::string_view text): _text(text) {}
+
+bool UniverseReader::readHeader(size_t* count, double* radius) {
+    if (!nextLine()) {
+        return fail("missing body count");
+    }
+    std::string_view field;
+    token(&field);
+    auto [end, ec] = std::from_chars(field.data(),
+                                     field.data() + field.size(), *count);
+    if (ec != std::errc() || end != field.data() + field.size()) {
+        return fail("body count must be a non-negative integer, got '"
+                    + std::string(field) + "'");
+    }
+
+    if (!nextLine()) {
+        return fail("missing universe radius");
+    }
+    if (!number(radius, "radius")) {
+        return false;
+    }
+    _remaining = *count;
+    return true;
+}
+
+bool UniverseReader::next(BodyRecord* body) {
+    if (_failed || _remaining == 0) {
+        return false;
+    }
+    if (!nextLine()) {
+        return fail("expected " + std::to_string(_remaining)
+                    + " more bodies, reached end of input");
+    }
+    if (!number(&body->x, "x position") ||
+        !number(&body->y, "y position") ||
+        !number(&body->vx, "x velocity") ||
+        !number(&body->vy, "y velocity") ||
+        !number(&body->mass, "mass")) {
+        return false;
+    }
+    if (!token(&body->image)) {
+        return fail("missing image file name");
+    }
+    _remaining--;
+    return true;
+}
+
+bool UniverseReader::done() const { return !_failed && _remaining == 0; }
+
+size_t UniverseReader::line() const { return _line; }
+
+const ParseError& UniverseReader::error() const { return _error; }
+
+bool UniverseReader::failed() const { return _failed; }
+
+// Advances to the next line holding anything but whitespace.
+bool UniverseReader::nextLine() {
+    while (_pos < _text.size()) {
+        size_t end = _text.find('\n', _pos);
+        if (end == std::string_view::npos) {
+            end = _text.size();
+        }
+        _current = _text.substr(_pos, end - _pos);
+        _pos = end + 1;
+        _line++;
+        if (_current.find_first_not_of(" \t\r") != std::string_view::npos) {
+            return true;
+        }
+    }
+    _current = {};
+    return false;
+}
+
+bool UniverseReader::token(std::string_view* out) {
+    size_t begin = _current.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos) {
+        *out = {};
+        _current = {};
+        return false;
+    }
+    size_t end = _current.find_first_of(" \t\r", begin);
+    if (end == std::string_view::npos) {
+        end = _current.size();
+    }
+    *out = _current.substr(begin, end - begin);
+    _current.remove_prefix(end);
+    return true;
+}
+
+bool UniverseReader::number(double* out, const char* what) {
+    std::string_view field;
+    if (!token(&field)) {
+        return fail(std::string("missing ") + what);
+    }
+    // from_chars rejects an explicit plus sign; printf-style output uses one.
+    std::string_view digits = field;
+    if (digits.size() > 1 && digits[0] == '+') {
+        digits.remove_prefix(1);
+    }
+    auto [end, ec] = std::from_chars(digits.data(),
+                                     digits.data() + digits.size(), *out);
+    if (ec != std::errc() || end != digits.data() + digits.size()) {
+        return fail(std::string("bad ") + what + " '" + std::string(field)
+                    + "'");
+    }
+    return true;
+}
+
+bool UniverseReader::fail(const std::string& message) {
+    _failed = true;
+    _error.line = _line;
+    _error.message = message;
+    return false;
+}
@@ -0,0 +1,66 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace NB {
+// Where and why a universe file was rejected. line is 1-based; 0 means the
+// problem is not tied to a line (the file could not be read at all).
+struct ParseError {
+    size_t line = 0;
+    std::string message;
+
+    std::string describe() const;  // "line 4: ..." or just the message
+};
+
+class ParseException : public std::runtime_error {
+ public:
+    explicit ParseException(const ParseError& error);
+    const ParseError& error() const;
+
+ private:
+    ParseError _error;
+};
+
+// One body line. image points into the text being parsed.
+struct BodyRecord {
+    double x = 0, y = 0, vx = 0, vy = 0, mass = 0;
+    std::string_view image;
+};
+
+// Streams a universe description ("N", "R", then N lines of
+// "x y vx vy mass image") straight out of a buffer with std::from_chars.
+// Nothing is allocated per line. Blank lines are skipped, anything after
+// the last body is ignored, and the first malformed line stops the reader
+// with error() describing it.
+class UniverseReader {
+ public:
+    explicit UniverseReader(std::string_view text);
+
+    bool readHeader(size_t* count, double* radius);
+    bool next(BodyRecord* body);  // false on error or after the last body
+    bool done() const;            // all announced bodies were read
+
+    size_t line() const;  // line of the last record returned
+    const ParseError& error() const;
+    bool failed() const;
+
+ private:
+    std::string_view _text;
+    size_t _pos = 0;
+    size_t _line = 0;
+    size_t _remaining = 0;
+    std::string_view _current;  // the line being tokenized
+    ParseError _error;
+    bool _failed = false;
+
+    bool nextLine();
+    bool token(std::string_view* out);
+    bool number(double* out, const char* what);
+    bool fail(const std::string& message);
+};
+}  // namespace NB
@@ -0,0 +1,284 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Universe.hpp"
+#include "CelestialBody.hpp"
+#include "Ensemble.hpp"
+#include "Profiler.hpp"
+#include "TrajectoryRecorder.hpp"
+using NB::Universe;
+using NB::CelestialBody;
+
+// Universe description with n bodies scattered uniformly over a disk of
+// radius 1e11 m, in the text format NBody reads.
+static std::string clusterText(size_t n, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    const double radius = 1.0e11;
+
+    std::ostringstream out;
+    out.precision(17);
+    out << n << "\n" << radius << "\n";
+    for (size_t i = 0; i < n; i++) {
+        double r = radius * std::sqrt(unit(rng));
+        double a = 2.0 * M_PI * unit(rng);
+        out << r * std::cos(a) << " " << r * std::sin(a) << " "
+            << 0.0 << " " << 0.0 << " " << 1.0e22 + 1.0e24 * unit(rng)
+            << " body.gif\n";
+    }
+    return out.str();
+}
+
+static void makeUniverse(Universe& universe, size_t n) {
+    NB::ParseError error;
+    if (!universe.load(clusterText(n, 42), &error)) {
+        std::fprintf(stderr, "%s\n", error.describe().c_str());
+        std::abort();
+    }
+}
+
+// Reports the force terms the solver actually summed per second (the
+// profiler's Interactions counter), the all-pairs rate a direct sum would
+// need for the same steps in that time, and nanoseconds per body per step,
+// all over the wall time of the loop.
+static void report(benchmark::State& state, size_t n, size_t steps,
+                   double seconds, uint64_t interactions) {
+    double pairs = static_cast<double>(n) * static_cast<double>(n - 1);
+    state.counters["interactions/s"] = interactions / seconds;
+    state.counters["direct-equivalent/s"] = pairs * steps / seconds;
+    state.counters["ns/body/step"] = seconds * 1e9 / (n * steps);
+}
+
+static void BM_Parse(benchmark::State& state) {
+    const size_t n = state.range(0);
+    const std::string text = clusterText(n, 42);
+    Universe universe;
+    NB::ParseError error;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(universe.load(text, &error));
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+// steps physics steps per iteration with the given solver.
+static void runSteps(benchmark::State& state, NB::Solver solver,
+                     size_t steps, NB::TrajectoryRecorder* recorder) {
+    const size_t n = state.range(0);
+    Universe universe;
+    makeUniverse(universe, n);
+    universe.setSolver(solver);
+
+    // The profiler counts the force terms; its timers cost a few clock
+    // reads per step.
+    const bool profiling = NB::Profiler::enabled();
+    NB::Profiler::reset();
+    NB::Profiler::setEnabled(true);
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto _ : state) {
+        for (size_t k = 0; k < steps; k++) {
+            universe.step(1.0);
+            total++;
+            if (recorder) {
+                recorder->record(universe.state(), total, total);
+            }
+        }
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    NB::Profiler::setEnabled(profiling);
+    report(state, n, total, elapsed.count(),
+           NB::Profiler::value(NB::Metric::Interactions));
+}
+
+static void BM_Step(benchmark::State& state, NB::Solver solver) {
+    runSteps(state, solver, 1, nullptr);
+}
+
+static void BM_Run(benchmark::State& state, NB::Solver solver) {
+    runSteps(state, solver, 10, nullptr);
+}
+
+// BM_Step with every step recorded, to measure the recorder's overhead.
+static void BM_StepRecorded(benchmark::State& state, NB::Solver solver) {
+    NB::TrajectoryRecorder recorder;
+    std::string message;
+    if (!recorder.open("bench_trajectory.bin", NB::TrajectoryFormat::Binary,
+                       state.range(0), &message)) {
+        state.SkipWithError(message.c_str());
+        return;
+    }
+    runSteps(state, solver, 1, &recorder);
+    recorder.close();
+    state.counters["stalls"] = recorder.stalls();
+    std::remove("bench_trajectory.bin");
+}
+
+// 100 steps of range(0) copies of a 9-body system: one process looping
+// over Universes against the interleaved ensemble on one thread and on
+// every core. Items are member-steps.
+static void BM_EnsembleSerial(benchmark::State& state) {
+    const size_t members = state.range(0);
+    std::vector<std::unique_ptr<Universe>> copies;
+    for (size_t k = 0; k < members; k++) {
+        copies.push_back(std::make_unique<Universe>());
+        makeUniverse(*copies.back(), 9);
+    }
+    for (auto _ : state) {
+        for (auto& universe : copies) {
+            for (int s = 0; s < 100; s++) {
+                universe->step(3600.0);
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * members * 100);
+}
+
+static void BM_Ensemble(benchmark::State& state, size_t threads) {
+    Universe base;
+    makeUniverse(base, 9);
+    NB::Ensemble ensemble;
+    ensemble.reset(base.state(), state.range(0), 1e-6, 1);
+    NB::ThreadPool pool(threads);
+    for (auto _ : state) {
+        ensemble.run(3600.0, 100, threads == 1 ? nullptr : &pool);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * 100);
+}
+
+// A direct step in single precision, against BM_Step/direct.
+static void BM_StepFloat(benchmark::State& state) {
+    const size_t n = state.range(0);
+    Universe universe;
+    makeUniverse(universe, n);
+    universe.setPrecision(NB::Precision::Float);
+    for (auto _ : state) {
+        universe.step(0.0);
+    }
+    state.SetItemsProcessed(state.iterations() * n * n);
+}
+
+// BM_Step/barnes_hut with the bodies kept in Hilbert order, sorted every
+// 20 steps; the input order of clusterText is random.
+static void BM_StepReordered(benchmark::State& state) {
+    const size_t n = state.range(0);
+    Universe universe;
+    makeUniverse(universe, n);
+    universe.setSolver(NB::Solver::BarnesHut);
+    universe.setReorderInterval(20);
+    universe.reorder();
+    for (auto _ : state) {
+        universe.step(1.0);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+// BM_Step with the conserved quantities measured after every step, to
+// show what summing the potential in the force pass costs.
+static void BM_StepMeasured(benchmark::State& state, NB::Solver solver,
+                            NB::Integrator integrator) {
+    const size_t n = state.range(0);
+    Universe universe;
+    makeUniverse(universe, n);
+    universe.setSolver(solver);
+    universe.setIntegrator(integrator);
+    universe.setDiagnosticsInterval(1);
+    universe.step(1.0);  // from here every step computes forces once
+    for (auto _ : state) {
+        universe.step(1.0);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+// One force evaluation at 10k bodies for a given FMM order, with the RMS
+// relative acceleration error against the direct sum as a counter.
+static void BM_FmmOrder(benchmark::State& state) {
+    const size_t n = 10000;
+    Universe reference;
+    makeUniverse(reference, n);
+    reference.step(0.0);
+    Universe fmm;
+    makeUniverse(fmm, n);
+    fmm.setSolver(NB::Solver::Fmm);
+    fmm.setFmmOrder(state.range(0));
+    for (auto _ : state) {
+        fmm.step(0.0);
+    }
+
+    const NB::BodyState& a = fmm.state();
+    const NB::BodyState& b = reference.state();
+    double error = 0.0, norm = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double dx = a.ax[i] - b.ax[i];
+        double dy = a.ay[i] - b.ay[i];
+        error += dx * dx + dy * dy;
+        norm += b.ax[i] * b.ax[i] + b.ay[i] * b.ay[i];
+    }
+    state.counters["error"] = std::sqrt(error / norm);
+}
+
+BENCHMARK(BM_Parse)->Arg(10)->Arg(1000)->Arg(10000)->Arg(100000)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Step, direct, NB::Solver::Direct)
+    ->Arg(10)->Arg(1000)->Arg(10000)->Arg(100000)
+    ->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Step, barnes_hut, NB::Solver::BarnesHut)
+    ->Arg(10)->Arg(1000)->Arg(10000)->Arg(100000)
+    ->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Step, fmm, NB::Solver::Fmm)
+    ->Arg(10)->Arg(1000)->Arg(10000)->Arg(100000)
+    ->Unit(benchmark::kMicrosecond)->UseRealTime();
+// Ten direct steps at 100k bodies take minutes; Barnes-Hut covers that size.
+BENCHMARK_CAPTURE(BM_Run, direct, NB::Solver::Direct)
+    ->Arg(10)->Arg(1000)->Arg(10000)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Run, barnes_hut, NB::Solver::BarnesHut)
+    ->Arg(10)->Arg(1000)->Arg(10000)->Arg(100000)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Run, fmm, NB::Solver::Fmm)
+    ->Arg(10)->Arg(1000)->Arg(10000)->Arg(100000)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_StepFloat)->Arg(1000)->Arg(10000)
+    ->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_StepReordered)->Arg(10000)->Arg(100000)
+    ->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_StepMeasured, direct, NB::Solver::Direct,
+                  NB::Integrator::Euler)
+    ->Arg(10000)->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_StepMeasured, barnes_hut, NB::Solver::BarnesHut,
+                  NB::Integrator::Euler)
+    ->Arg(10000)->Arg(100000)->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_StepMeasured, barnes_hut_yoshida4,
+                  NB::Solver::BarnesHut, NB::Integrator::Yoshida4)
+    ->Arg(10000)->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_EnsembleSerial)->Arg(1024)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Ensemble, one_thread, 1)->Arg(1024)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Ensemble, all_threads, 0)->Arg(1024)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_FmmOrder)->Arg(2)->Arg(4)->Arg(8)->Arg(12)->Arg(16)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_StepRecorded, barnes_hut, NB::Solver::BarnesHut)
+    ->Arg(10000)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+int main(int argc, char** argv) {
+    CelestialBody::setLoadTextures(false);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
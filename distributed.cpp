@@ -0,0 +1,171 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <mpi.h>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include "CelestialBody.hpp"
+#include "Distributed.hpp"
+#include "Universe.hpp"
+using NB::Universe;
+
+struct Options {
+    double time = 0.0;
+    double deltaTime = 0.0;
+    std::string input;   // snapshot files
+    std::string output;
+    double theta = 0.5;
+    double softening = 0.0;
+    NB::Integrator integrator = NB::Integrator::Euler;
+    double imbalance = 0.2;
+    size_t threads = 1;
+    bool verify = false;
+};
+
+static void usage() {
+    std::cerr << "Usage: mpirun -np P ./NBodyMPI T dt input.snap output.snap"
+              << " [--theta angle] [--softening eps]"
+              << " [--integrator euler|leapfrog] [--imbalance f]"
+              << " [--threads n] [--verify]\n";
+}
+
+static bool parseOptions(int argc, char* argv[], Options* options) {
+    if (argc < 5) {
+        return false;
+    }
+    options->time = std::stod(argv[1]);
+    options->deltaTime = std::stod(argv[2]);
+    options->input = argv[3];
+    options->output = argv[4];
+    for (int i = 5; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--theta" && i + 1 < argc) {
+            options->theta = std::stod(argv[++i]);
+        } else if (arg == "--softening" && i + 1 < argc) {
+            options->softening = std::stod(argv[++i]);
+        } else if (arg == "--integrator" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (!NB::parseIntegrator(name, &options->integrator) ||
+                (options->integrator != NB::Integrator::Euler &&
+                 options->integrator != NB::Integrator::Leapfrog)) {
+                std::cerr << "Unsupported integrator: " << name << "\n";
+                return false;
+            }
+        } else if (arg == "--imbalance" && i + 1 < argc) {
+            options->imbalance = std::stod(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options->threads = std::stoul(argv[++i]);
+        } else if (arg == "--verify") {
+            options->verify = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// RMS relative difference between the accelerations of the first force
+// pass and the direct sum, computed on rank 0.
+static double forceError(const NB::BodyState& distributed,
+                         const Universe& universe) {
+    const NB::BodyState& direct = universe.state();
+    double error = 0.0, norm = 0.0;
+    for (size_t i = 0; i < direct.size(); i++) {
+        double dx = distributed.ax[i] - direct.ax[i];
+        double dy = distributed.ay[i] - direct.ay[i];
+        error += dx * dx + dy * dy;
+        norm += direct.ax[i] * direct.ax[i] + direct.ay[i] * direct.ay[i];
+    }
+    return norm > 0 ? std::sqrt(error / norm) : 0.0;
+}
+
+static int run(const Options& options, int rank) {
+    // Every rank maps the input and reads only its own slice of it.
+    NB::SnapshotReader input;
+    NB::ParseError error;
+    int opened = input.open(options.input, &error), allOpened = 0;
+    MPI_Allreduce(&opened, &allOpened, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!allOpened) {
+        if (!opened) {
+            std::cerr << "Error reading universe on rank " << rank << ": "
+                      << error.describe() << "\n";
+        }
+        return 1;
+    }
+
+    NB::DistributedUniverse distributed(MPI_COMM_WORLD);
+    distributed.setTheta(options.theta);
+    distributed.setSoftening(options.softening);
+    distributed.setIntegrator(options.integrator);
+    distributed.setImbalance(options.imbalance);
+    distributed.setThreads(options.threads);
+    distributed.load(input);
+
+    if (options.verify) {
+        distributed.step(0.0);
+        NB::BodyState result;
+        distributed.gather(&result);
+        int passed = 1;
+        if (rank == 0) {
+            // The direct sum needs every body on rank 0.
+            Universe universe;
+            NB::SnapshotInfo info;
+            passed = universe.loadSnapshot(options.input, &info, &error);
+            if (passed) {
+                universe.setSoftening(options.softening);
+                universe.step(0.0);
+                double difference = forceError(result, universe);
+                std::cerr << "Force error against the direct sum: "
+                          << difference << "\n";
+                passed = difference < 1e-2;
+            } else {
+                std::cerr << "Error reading universe: " << error.describe()
+                          << "\n";
+            }
+        }
+        MPI_Bcast(&passed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (!passed) {
+            return 1;
+        }
+    }
+
+    NB::SnapshotInfo info = input.info();
+    for (double time = 0.0; time < options.time; time += options.deltaTime) {
+        distributed.step(options.deltaTime);
+        info.time += options.deltaTime;
+        info.steps++;
+    }
+    std::string message;
+    if (!distributed.save(options.output, input, info, &message)) {
+        if (rank == 0) {
+            std::cerr << "Error writing universe: " << message << "\n";
+        }
+        return 1;
+    }
+
+    if (rank == 0) {
+        std::cerr << distributed.ranks() << " ranks, "
+                  << info.steps - input.info().steps << " steps, "
+                  << distributed.rebalances() << " decompositions, load"
+                  << " imbalance " << distributed.imbalance() << "\n";
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    NB::CelestialBody::setLoadTextures(false);
+
+    Options options;
+    int status = 1;
+    if (parseOptions(argc, argv, &options)) {
+        status = run(options, rank);
+    } else if (rank == 0) {
+        usage();
+    }
+    MPI_Finalize();
+    return status;
+}
@@ -0,0 +1,79 @@
+// Copyright 2025 by Mohamed Bouchtout
+
+#include <charconv>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include "Scenario.hpp"
+
+static void usage() {
+    std::cerr << "Usage: ./NBodyGen plummer|disk|belt|galaxies N"
+              << " [--seed s] [--mass kg] [--scale m] [--base universe.txt]"
+              << " [--image file] [--snapshot file] > universe.txt\n";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+
+    NB::ScenarioOptions options;
+    if (!NB::parseScenario(argv[1], &options.kind)) {
+        std::cerr << "Unknown scenario: " << argv[1] << "\n";
+        usage();
+        return 1;
+    }
+    // from_chars takes no sign for an unsigned count, so "-5" is rejected
+    // instead of wrapping around to a huge one.
+    const std::string_view count = argv[2];
+    auto parsed = std::from_chars(count.data(), count.data() + count.size(),
+                                  options.count);
+    if (parsed.ec != std::errc() ||
+        parsed.ptr != count.data() + count.size()) {
+        std::cerr << "Invalid body count: " << count << "\n";
+        usage();
+        return 1;
+    }
+
+    std::string snapshot;
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc) {
+            options.seed = std::stoull(argv[++i]);
+        } else if (arg == "--mass" && i + 1 < argc) {
+            options.mass = std::stod(argv[++i]);
+        } else if (arg == "--scale" && i + 1 < argc) {
+            options.scale = std::stod(argv[++i]);
+        } else if (arg == "--base" && i + 1 < argc) {
+            options.base = argv[++i];
+        } else if (arg == "--image" && i + 1 < argc) {
+            options.image = argv[++i];
+        } else if (arg == "--snapshot" && i + 1 < argc) {
+            snapshot = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    NB::Scenario scenario;
+    std::string error;
+    if (!NB::generateScenario(options, &scenario, &error)) {
+        std::cerr << "Error: " << error << "\n";
+        return 1;
+    }
+
+    if (!snapshot.empty()) {
+        if (!NB::writeScenarioSnapshot(scenario, snapshot, &error)) {
+            std::cerr << "Error: " << error << "\n";
+            return 1;
+        }
+    } else if (!NB::writeScenarioText(scenario, stdout)) {
+        std::cerr << "Error: failed writing the universe\n";
+        return 1;
+    }
+    return 0;
+}
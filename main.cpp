@@ -1,69 +1,570 @@
 // Copyright 2025 by Mohamed Bouchtout
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <thread>
+#include <vector>
 #include <SFML/Graphics.hpp>
 #include <SFML/Audio.hpp>
 #include "Universe.hpp"
+#include "BatchRenderer.hpp"
 #include "CelestialBody.hpp"
+#include "Conservation.hpp"
+#include "Ensemble.hpp"
+#include "FrameExchange.hpp"
+#include "Profiler.hpp"
+#include "TrajectoryRecorder.hpp"
 using NB::Universe;
 using NB::CelestialBody;
 
-int main(int argc, char* argv[]) {
-    if (argc != 3) {
+struct Options {
+    double time = 0.0;
+    double deltaTime = 0.0;
+    NB::Solver solver = NB::Solver::Direct;
+    double theta = 0.5;
+    int fmmOrder = 8;
+    size_t threads = 1;
+    bool simd = false;
+    NB::Precision precision = NB::Precision::Double;
+    double softening = 0.0;
+    bool collisions = false;
+    double collisionDensity = 5500.0;
+    NB::Integrator integrator = NB::Integrator::Euler;
+    int blockLevels = 8;
+    bool headless = false;
+    bool pipeline = false;
+    int stepsPerFrame = 1;
+    bool batch = false;
+    float bodyScale = 1.0f;
+    size_t reorderEvery = 0;       // steps between curve sorts, 0 never
+    size_t diagnosticsEvery = 0;   // steps between conservation checks
+    double energyTolerance = 0.0;  // relative drift, 0 does not check
+    double momentumTolerance = 0.0;
+    bool abortOnDrift = false;
+    std::string checkpoint;        // snapshot path, empty for none
+    uint64_t checkpointEvery = 0;  // steps between checkpoints
+    std::string resume;            // snapshot to start from, not stdin
+    std::string record;            // trajectory path, empty for none
+    uint64_t recordStride = 1;
+    std::vector<uint32_t> recordBodies;  // empty records every body
+    bool profile = false;
+    uint64_t profileEvery = 0;     // steps between summaries, 0 at the end
+    std::string trace;             // Chrome trace path, empty for none
+    size_t ensemble = 0;           // perturbed copies to run, 0 for none
+    double perturb = 1e-6;         // relative spread of the copies
+    uint64_t seed = 1;
+};
+
+// Where the run stands; time and steps are saved with every checkpoint.
+struct Progress {
+    double time = 0.0;
+    uint64_t steps = 0;
+    bool aborted = false;  // a conservation check stopped the run
+};
+
+static void usage() {
+    std::cerr << "Usage: ./NBody T dt [--solver direct|barnes-hut|fmm]"
+              << " [--fmm-order p]"
+              << " [--theta angle] [--threads n] [--simd]"
+              << " [--precision double|float]"
+              << " [--softening eps] [--collisions] [--collision-density rho]"
+              << " [--integrator euler|leapfrog|yoshida4|rk4|block]"
+              << " [--block-levels n] [--headless] [--pipeline]"
+              << " [--steps-per-frame n]"
+              << " [--batch] [--body-scale s] [--reorder-every n]"
+              << " [--diagnostics-every n] [--energy-tolerance f]"
+              << " [--momentum-tolerance f] [--abort-on-drift]"
+              << " [--checkpoint file] [--checkpoint-every n]"
+              << " [--resume file] [--record file] [--record-stride n]"
+              << " [--record-bodies i,j,...] [--profile]"
+              << " [--profile-every n] [--trace file]"
+              << " [--ensemble k] [--perturb s] [--seed n] < universe.txt\n";
+}
+
+static bool parseOptions(int argc, char* argv[], Options* options) {
+    if (argc < 3) {
         std::cerr << "No file name found\n";
-        return 1;
+        usage();
+        return false;
     }
 
-    double time = std::stod(argv[1]);
-    double deltaTime = std::stod(argv[2]);
+    options->time = std::stod(argv[1]);
+    options->deltaTime = std::stod(argv[2]);
 
-    Universe universe;
-    std::cin >> universe;
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--solver" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "direct") {
+                options->solver = NB::Solver::Direct;
+            } else if (name == "barnes-hut" || name == "bh") {
+                options->solver = NB::Solver::BarnesHut;
+            } else if (name == "fmm") {
+                options->solver = NB::Solver::Fmm;
+            } else {
+                std::cerr << "Unknown solver: " << name << "\n";
+                return false;
+            }
+        } else if (arg == "--theta" && i + 1 < argc) {
+            options->theta = std::stod(argv[++i]);
+        } else if (arg == "--fmm-order" && i + 1 < argc) {
+            options->fmmOrder = std::stoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options->threads = std::stoul(argv[++i]);
+        } else if (arg == "--simd") {
+            options->simd = true;
+        } else if (arg == "--precision" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "double") {
+                options->precision = NB::Precision::Double;
+            } else if (name == "float") {
+                options->precision = NB::Precision::Float;
+            } else {
+                std::cerr << "Unknown precision: " << name << "\n";
+                return false;
+            }
+        } else if (arg == "--softening" && i + 1 < argc) {
+            options->softening = std::stod(argv[++i]);
+        } else if (arg == "--collisions") {
+            options->collisions = true;
+        } else if (arg == "--collision-density" && i + 1 < argc) {
+            options->collisions = true;
+            options->collisionDensity = std::stod(argv[++i]);
+        } else if (arg == "--integrator" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (!NB::parseIntegrator(name, &options->integrator)) {
+                std::cerr << "Unknown integrator: " << name << "\n";
+                return false;
+            }
+        } else if (arg == "--block-levels" && i + 1 < argc) {
+            options->blockLevels = std::stoi(argv[++i]);
+        } else if (arg == "--headless") {
+            options->headless = true;
+        } else if (arg == "--pipeline") {
+            options->pipeline = true;
+        } else if (arg == "--steps-per-frame" && i + 1 < argc) {
+            options->stepsPerFrame = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--batch") {
+            options->batch = true;
+        } else if (arg == "--reorder-every" && i + 1 < argc) {
+            options->reorderEvery = std::stoul(argv[++i]);
+        } else if (arg == "--diagnostics-every" && i + 1 < argc) {
+            options->diagnosticsEvery = std::stoul(argv[++i]);
+        } else if (arg == "--energy-tolerance" && i + 1 < argc) {
+            options->energyTolerance = std::stod(argv[++i]);
+        } else if (arg == "--momentum-tolerance" && i + 1 < argc) {
+            options->momentumTolerance = std::stod(argv[++i]);
+        } else if (arg == "--abort-on-drift") {
+            options->abortOnDrift = true;
+        } else if (arg == "--body-scale" && i + 1 < argc) {
+            options->bodyScale = std::stof(argv[++i]);
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            options->checkpoint = argv[++i];
+        } else if (arg == "--checkpoint-every" && i + 1 < argc) {
+            options->checkpointEvery = std::stoull(argv[++i]);
+        } else if (arg == "--resume" && i + 1 < argc) {
+            options->resume = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            options->record = argv[++i];
+        } else if (arg == "--record-stride" && i + 1 < argc) {
+            options->recordStride = std::stoull(argv[++i]);
+        } else if (arg == "--record-bodies" && i + 1 < argc) {
+            std::istringstream list(argv[++i]);
+            std::string index;
+            while (std::getline(list, index, ',')) {
+                options->recordBodies.push_back(std::stoul(index));
+            }
+        } else if (arg == "--profile") {
+            options->profile = true;
+        } else if (arg == "--profile-every" && i + 1 < argc) {
+            options->profile = true;
+            options->profileEvery = std::stoull(argv[++i]);
+        } else if (arg == "--trace" && i + 1 < argc) {
+            options->trace = argv[++i];
+        } else if (arg == "--ensemble" && i + 1 < argc) {
+            options->ensemble = std::stoul(argv[++i]);
+        } else if (arg == "--perturb" && i + 1 < argc) {
+            options->perturb = std::stod(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            options->seed = std::stoull(argv[++i]);
+        } else {
+            usage();
+            return false;
+        }
+    }
+    // The render thread draws from snapshots with a fixed set of bodies.
+    if (options->pipeline && options->collisions) {
+        std::cerr << "--pipeline cannot be combined with --collisions\n";
+        return false;
+    }
+    // Block steps sum the forces on active bodies exactly, over all pairs.
+    if (options->integrator == NB::Integrator::Block &&
+        options->solver != NB::Solver::Direct) {
+        std::cerr << "--integrator block needs the direct solver\n";
+        return false;
+    }
+    if ((options->energyTolerance > 0 || options->momentumTolerance > 0 ||
+         options->abortOnDrift) && options->diagnosticsEvery == 0) {
+        std::cerr << "Drift tolerances need --diagnostics-every\n";
+        return false;
+    }
+    // Ensemble members are stepped by their own direct kernel.
+    if (options->ensemble > 0) {
+        if (options->solver != NB::Solver::Direct || options->collisions ||
+            options->pipeline || !options->record.empty() ||
+            !options->checkpoint.empty() || options->diagnosticsEvery > 0) {
+            std::cerr << "--ensemble needs the direct solver and cannot be"
+                      << " combined with --collisions, --pipeline, --record,"
+                      << " --checkpoint or --diagnostics-every\n";
+            return false;
+        }
+        if (options->integrator != NB::Integrator::Euler &&
+            options->integrator != NB::Integrator::Leapfrog) {
+            std::cerr << "--ensemble supports the euler and leapfrog"
+                      << " integrators\n";
+            return false;
+        }
+        options->headless = true;
+    }
+    return true;
+}
+
+static void checkpoint(const Universe& universe, const Options& options,
+                       const Progress& progress) {
+    NB::ScopedTimer timer(NB::Phase::Checkpoint);
+    std::string error;
+    if (!universe.saveSnapshot(options.checkpoint,
+                               {progress.time, progress.steps}, &error)) {
+        std::cerr << "Warning: checkpoint failed: " << error << "\n";
+    }
+}
 
-    double currentTime = 0.0;
-    sf::Clock clock;
+// Advances one step, then records it, checks the conserved quantities and
+// writes a checkpoint when due.
+static void advance(Universe& universe, const Options& options,
+                    Progress* progress, NB::TrajectoryRecorder* recorder,
+                    NB::ConservationMonitor* monitor) {
+    universe.step(options.deltaTime);
+    progress->time += options.deltaTime;
+    progress->steps++;
+    if (universe.measured() &&
+        monitor->check(universe.conservation(), progress->time,
+                       progress->steps, std::cerr) ==
+            NB::ConservationMonitor::Verdict::Abort) {
+        progress->aborted = true;
+    }
+    {
+        NB::ScopedTimer timer(NB::Phase::Record);
+        recorder->record(universe.state(), progress->time, progress->steps,
+                         &universe.inputSlots());
+    }
+    if (!options.checkpoint.empty() && options.checkpointEvery > 0 &&
+        progress->steps % options.checkpointEvery == 0) {
+        checkpoint(universe, options, *progress);
+    }
+    if (options.profileEvery > 0 &&
+        progress->steps % options.profileEvery == 0) {
+        std::cerr << "Profile after " << progress->steps << " steps:\n";
+        NB::Profiler::printSummary(std::cerr);
+    }
+}
 
+// Steps as fast as the machine allows, with no window or assets.
+static void runHeadless(Universe& universe, const Options& options,
+                        Progress* progress, NB::TrajectoryRecorder* recorder,
+                        NB::ConservationMonitor* monitor) {
+    while (progress->time < options.time && !progress->aborted) {
+        advance(universe, options, progress, recorder, monitor);
+    }
+}
+
+// Runs options.ensemble perturbed copies of universe for as many steps as
+// runHeadless would take, then prints every member in the universe format,
+// member 0 (the unperturbed one) first.
+static void runEnsemble(const Universe& universe, const Options& options,
+                        const Progress& progress) {
+    uint64_t steps = 0;
+    for (double time = progress.time; time < options.time;
+         time += options.deltaTime) {
+        steps++;
+    }
+
+    NB::Ensemble ensemble;
+    ensemble.reset(universe.state(), options.ensemble, options.perturb,
+                   options.seed);
+    ensemble.setSoftening(options.softening);
+    ensemble.setIntegrator(options.integrator);
+    NB::ThreadPool pool(options.threads);
+    ensemble.run(options.deltaTime, steps,
+                 options.threads == 1 ? nullptr : &pool);
+
+    NB::BodyState member;
+    for (size_t k = 0; k < ensemble.members(); k++) {
+        ensemble.member(k, &member);
+        std::cout << member.size() << "\n" << universe.radius() << "\n";
+        for (size_t i = 0; i < member.size(); i++) {
+            std::cout << member.x[i] << " " << member.y[i] << " "
+                      << member.vx[i] << " " << member.vy[i] << " "
+                      << member.mass[i] << " " << universe[i].filename()
+                      << "\n";
+        }
+        std::cout << std::endl;
+    }
+}
+
+// The window and the elapsed-time caption shared by both windowed modes.
+struct Screen {
     sf::Font font;
-    if (!font.loadFromFile("font.ttf")) {
+    sf::Text timeText;
+    sf::RenderWindow window;
+};
+
+static bool openScreen(Screen* screen) {
+    if (!screen->font.loadFromFile("font.ttf")) {
         std::cerr << "Error: Failed to load font.\n";
-        return 1;
+        return false;
     }
 
-    sf::Text timeText;
-    timeText.setFont(font);
-    timeText.setCharacterSize(24);
-    timeText.setFillColor(sf::Color::White);
-    timeText.setPosition(-200, -380);
+    screen->timeText.setFont(screen->font);
+    screen->timeText.setCharacterSize(24);
+    screen->timeText.setFillColor(sf::Color::White);
+    screen->timeText.setPosition(-200, -380);
 
-    sf::RenderWindow window(sf::VideoMode(800, 800), "The Solar System!");
+    screen->window.create(sf::VideoMode(800, 800), "The Solar System!");
     sf::View view;
     view.setSize(800, 800);
     view.setCenter(0, 0);
-    window.setView(view);
+    screen->window.setView(view);
+    return true;
+}
 
-    while (window.isOpen() && currentTime < time) {
-        sf::Event event;
-        while (window.pollEvent(event)) {
-            if (event.type == sf::Event::Closed)
-                window.close();
-        }
+static void pollEvents(sf::RenderWindow& window) {
+    NB::ScopedTimer timer(NB::Phase::Events);
+    sf::Event event;
+    while (window.pollEvent(event)) {
+        if (event.type == sf::Event::Closed)
+            window.close();
+    }
+}
+
+static std::string elapsedTime(double time) {
+    std::ostringstream timeStream;
+    timeStream.precision(2);
+    timeStream << std::fixed << time;
+    return "Elapsed Time: " + timeStream.str() + " s";
+}
+
+// Runs stepsPerFrame physics steps for every rendered frame, so the
+// simulation rate is not capped by the display.
+static int runWindowed(Universe& universe, const Options& options,
+                       Progress* progress, NB::TrajectoryRecorder* recorder,
+                       NB::ConservationMonitor* monitor) {
+    Screen screen;
+    if (!openScreen(&screen)) {
+        return 1;
+    }
+    sf::RenderWindow& window = screen.window;
 
-        universe.step(deltaTime);
-        currentTime += deltaTime;
+    while (window.isOpen() && progress->time < options.time &&
+           !progress->aborted) {
+        pollEvents(window);
 
-        std::ostringstream timeStream;
-        timeStream.precision(2);
-        timeStream << std::fixed << currentTime;
-        timeText.setString("Elapsed Time: " + timeStream.str() + " s");
+        for (int k = 0; k < options.stepsPerFrame
+             && progress->time < options.time && !progress->aborted; k++) {
+            advance(universe, options, progress, recorder, monitor);
+        }
+        screen.timeText.setString(elapsedTime(progress->time));
 
+        NB::ScopedTimer timer(NB::Phase::Draw);
         window.clear();
         window.draw(universe);
-        window.draw(timeText);
+        window.draw(screen.timeText);
         window.display();
     }
+    return 0;
+}
 
-    std::cout << universe << std::endl;
+// Physics on a thread of its own, drawing on this one. Every
+// stepsPerFrame steps the simulation publishes the positions through a
+// FrameExchange and carries on without waiting for the display; the window
+// redraws at up to 60 frames per second, interpolating between the last
+// two frames it received. The bodies are drawn by a BatchRenderer built
+// before the simulation starts, since the universe's own sprites belong to
+// the physics thread.
+static int runPipelined(Universe& universe, const Options& options,
+                        Progress* progress, NB::TrajectoryRecorder* recorder,
+                        NB::ConservationMonitor* monitor) {
+    Screen screen;
+    if (!openScreen(&screen)) {
+        return 1;
+    }
+    sf::RenderWindow& window = screen.window;
+    window.setFramerateLimit(60);
+
+    NB::BatchRenderer renderer;
+    renderer.setBodyScale(options.bodyScale);
+    renderer.rebuild(universe.list());
+    const float scale = universe.scale();
+
+    NB::FrameExchange exchange;
+    auto publish = [&] {
+        const NB::BodyState& st = universe.state();
+        NB::FrameExchange::Frame& frame = exchange.back();
+        const std::vector<uint32_t>& slots = universe.slots();
+        frame.x.resize(slots.size());
+        frame.y.resize(slots.size());
+        for (size_t i = 0; i < slots.size(); i++) {
+            frame.x[i] = st.x[slots[i]];
+            frame.y[i] = st.y[slots[i]];
+        }
+        frame.time = progress->time;
+        frame.steps = progress->steps;
+        exchange.publish();
+    };
+    publish();
+
+    std::atomic<bool> stop{false};
+    std::atomic<bool> finished{false};
+    std::thread physics([&] {
+        while (!stop.load(std::memory_order_relaxed) &&
+               progress->time < options.time && !progress->aborted) {
+            for (int k = 0; k < options.stepsPerFrame
+                 && progress->time < options.time && !progress->aborted;
+                 k++) {
+                advance(universe, options, progress, recorder, monitor);
+            }
+            publish();
+        }
+        finished.store(true, std::memory_order_release);
+    });
+
+    NB::BodyState shown;
+    while (window.isOpen() && !finished.load(std::memory_order_acquire)) {
+        pollEvents(window);
+
+        exchange.acquire();
+        double time = exchange.blend(NB::Profiler::now(), &shown);
+        screen.timeText.setString(elapsedTime(time));
+
+        NB::ScopedTimer timer(NB::Phase::Draw);
+        renderer.update(shown, scale);
+        window.clear();
+        window.draw(renderer);
+        window.draw(screen.timeText);
+        window.display();
+    }
+
+    stop.store(true, std::memory_order_relaxed);
+    physics.join();
     return 0;
 }
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        return 1;
+    }
+
+    CelestialBody::setLoadTextures(!options.headless);
+    NB::Profiler::setEnabled(options.profile);
+    if (!options.trace.empty()) {
+        NB::Profiler::setTracing(true);
+    }
+
+    // stdin is memory-mapped when it is redirected from a file and read
+    // into memory when it is a pipe. A resumed run continues from the
+    // snapshot's time, so T stays the end time of the whole run.
+    Universe universe;
+    Progress progress;
+    NB::ParseError error;
+    if (!options.resume.empty()) {
+        NB::SnapshotInfo info;
+        if (!universe.loadSnapshot(options.resume, &info, &error)) {
+            std::cerr << "Error resuming: " << error.describe() << "\n";
+            return 1;
+        }
+        progress = {info.time, info.steps};
+    } else if (!universe.loadFile("/dev/stdin", &error)) {
+        std::cerr << "Error reading universe: " << error.describe() << "\n";
+        return 1;
+    }
+    universe.setSolver(options.solver);
+    universe.setTheta(options.theta);
+    universe.setFmmOrder(options.fmmOrder);
+    universe.setThreads(options.threads);
+    universe.setSimd(options.simd);
+    universe.setPrecision(options.precision);
+    universe.setSoftening(options.softening);
+    universe.setCollisions(options.collisions);
+    universe.setCollisionDensity(options.collisionDensity);
+    universe.setIntegrator(options.integrator);
+    universe.setBlockLevels(options.blockLevels);
+    universe.setBatchRendering(options.batch);
+    universe.setReorderInterval(options.reorderEvery);
+    universe.setDiagnosticsInterval(options.diagnosticsEvery);
+    universe.setBodyScale(options.bodyScale);
+    if (options.ensemble > 0) {
+        runEnsemble(universe, options, progress);
+        return 0;
+    }
+
+    NB::TrajectoryRecorder recorder;
+    if (!options.record.empty()) {
+        std::string message;
+        recorder.setStride(options.recordStride);
+        recorder.setBodies(options.recordBodies);
+        if (!recorder.open(options.record,
+                           NB::trajectoryFormatFor(options.record),
+                           universe.size(), &message)) {
+            std::cerr << "Error recording trajectory: " << message << "\n";
+            return 1;
+        }
+        recorder.record(universe.state(), progress.time, progress.steps,
+                        &universe.inputSlots());
+    }
+
+    // The first measurement, before any step, is the reference.
+    NB::ConservationMonitor monitor;
+    monitor.setEnergyTolerance(options.energyTolerance);
+    monitor.setMomentumTolerance(options.momentumTolerance);
+    monitor.setAbort(options.abortOnDrift);
+    if (options.diagnosticsEvery > 0) {
+        monitor.check(universe.measureConservation(), progress.time,
+                      progress.steps, std::cerr);
+    }
+
+    if (options.headless) {
+        runHeadless(universe, options, &progress, &recorder, &monitor);
+    } else if (options.pipeline) {
+        if (runPipelined(universe, options, &progress, &recorder,
+                         &monitor) != 0) {
+            return 1;
+        }
+    } else if (runWindowed(universe, options, &progress, &recorder,
+                           &monitor) != 0) {
+        return 1;
+    }
+    if (!recorder.close()) {
+        std::cerr << "Warning: trajectory " << options.record
+                  << " is incomplete\n";
+    }
+    if (!options.checkpoint.empty()) {
+        checkpoint(universe, options, progress);
+    }
+    if (options.profile && options.profileEvery == 0) {
+        NB::Profiler::printSummary(std::cerr);
+    }
+    if (!options.trace.empty()) {
+        std::string message;
+        if (!NB::Profiler::writeTrace(options.trace, &message)) {
+            std::cerr << "Warning: " << message << "\n";
+        }
+    }
+
+    std::cout << universe << std::endl;
+    return progress.aborted ? 2 : 0;
+}
@@ -3,19 +3,92 @@
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE Main
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <sstream>
+#include <thread>
 #include <cmath>
 #include <vector>
+#include <random>
+#include <memory>
 #include <SFML/Graphics.hpp>
 #include <boost/test/unit_test.hpp>
 #include "Universe.hpp"
 #include "CelestialBody.hpp"
+#include "BatchRenderer.hpp"
+#include "CollisionGrid.hpp"
+#include "Conservation.hpp"
+#include "Decomposition.hpp"
+#include "Ensemble.hpp"
+#include "FrameExchange.hpp"
+#include "Profiler.hpp"
+#include "Scenario.hpp"
+#include "SpaceFillingCurve.hpp"
+#include "TextureCache.hpp"
+#include "TrajectoryRecorder.hpp"
 using NB::Universe;
 using NB::CelestialBody;
 
 static const double G = 6.67430e-11;
 
+// Fills a universe with n bodies scattered uniformly over a disk, without
+// textures, for solver comparisons.
+static void makeCluster(Universe& universe, size_t n, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const float radius = 1.0e11f;
+
+    universe.setRadius(radius);
+    universe.setSize(n);
+    for (size_t i = 0; i < n; i++) {
+        float r = radius * std::sqrt(unit(rng));
+        float a = 2.0f * static_cast<float>(M_PI) * unit(rng);
+        auto body = std::make_shared<CelestialBody>();
+        body->setMass(1.0e22f + 1.0e24f * unit(rng));
+        body->setPosition({r * std::cos(a), r * std::sin(a)});
+        universe.addToList(body);
+    }
+}
+
+// Kinetic plus potential energy, summed directly.
+static double totalEnergy(const Universe& universe) {
+    const NB::BodyState& st = universe.state();
+    double energy = 0.0;
+    for (size_t i = 0; i < st.size(); i++) {
+        double v2 = st.vx[i] * st.vx[i] + st.vy[i] * st.vy[i];
+        energy += 0.5 * st.mass[i] * v2;
+        for (size_t j = i + 1; j < st.size(); j++) {
+            double dx = st.x[j] - st.x[i];
+            double dy = st.y[j] - st.y[i];
+            double r = std::sqrt(dx * dx + dy * dy);
+            energy -= G * st.mass[i] * st.mass[j] / r;
+        }
+    }
+    return energy;
+}
+
+// Norm of the acceleration error over all bodies relative to the norm of
+// the reference accelerations.
+static double relativeError(const Universe& universe,
+                            const Universe& reference) {
+    double error = 0.0;
+    double norm = 0.0;
+    for (size_t i = 0; i < reference.size(); i++) {
+        sf::Vector2<double> a = universe[i].acceleration();
+        sf::Vector2<double> b = reference[i].acceleration();
+        sf::Vector2<double> d = a - b;
+        error += d.x * d.x + d.y * d.y;
+        norm += b.x * b.x + b.y * b.y;
+    }
+    return std::sqrt(error / norm);
+}
+
 BOOST_AUTO_TEST_CASE(CelestialBody_InputStream) {
     std::istringstream input("1 2 3 4 5 earth.gif");
 
@@ -243,3 +316,1426 @@ BOOST_AUTO_TEST_CASE(Universe_Step_ExtraCredit) {
         BOOST_CHECK(universe[i].position() != initialPositions[i]);
     }
 }
+
+BOOST_AUTO_TEST_CASE(Universe_StateArrays) {
+    std::istringstream is(
+"2\n"
+"100\n"
+"1 2 3 4 5 earth.gif\n"
+"6 7 8 9 10 mars.gif\n");
+
+    Universe universe;
+    is >> universe;
+
+    const NB::BodyState& state = universe.state();
+    BOOST_CHECK_EQUAL(state.size(), 2);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(state.x.data()) % 64, 0);
+    BOOST_CHECK_CLOSE(state.x[1], 6.0, 1e-6);
+    BOOST_CHECK_CLOSE(state.mass[0], 5.0, 1e-6);
+
+    universe.step(1.0);
+    BOOST_CHECK_EQUAL(universe[0].precisePosition().x, state.x[0]);
+    BOOST_CHECK_EQUAL(universe[1].preciseVelocity().y, state.vy[1]);
+
+    std::shared_ptr<CelestialBody> body = universe.list()[0];
+    sf::Vector2<double> position = body->precisePosition();
+    universe.clearList();
+    BOOST_CHECK(!body->isBound());
+    BOOST_CHECK(body->precisePosition() == position);
+}
+
+BOOST_AUTO_TEST_CASE(Universe_BarnesHut_MatchesDirect) {
+    Universe direct;
+    Universe tree;
+    makeCluster(direct, 2000, 7);
+    makeCluster(tree, 2000, 7);
+    tree.setSolver(NB::Solver::BarnesHut);
+    tree.setTheta(0.5);
+
+    direct.step(0.0);
+    tree.step(0.0);
+
+    BOOST_CHECK_LT(relativeError(tree, direct), 1e-2);
+}
+
+// Error against the direct sum falls geometrically with the order, on a
+// uniform disk and on a strongly clustered Plummer sphere.
+BOOST_AUTO_TEST_CASE(Universe_Fmm_MatchesDirect) {
+    NB::ScenarioOptions options;
+    options.count = 4000;
+    NB::Scenario plummer;
+    std::string message;
+    BOOST_REQUIRE(NB::generateScenario(options, &plummer, &message));
+    auto fill = [&](Universe& universe, int scene) {
+        if (scene == 0) {
+            makeCluster(universe, 4000, 9);
+            return;
+        }
+        const NB::BodyState& st = plummer.state;
+        for (size_t i = 0; i < st.size(); i++) {
+            auto body = std::make_shared<CelestialBody>();
+            body->setPreciseMass(st.mass[i]);
+            body->setPrecisePosition({st.x[i], st.y[i]});
+            universe.addToList(body);
+        }
+        universe.setSize(st.size());
+    };
+
+    for (int scene = 0; scene < 2; scene++) {
+        Universe direct;
+        fill(direct, scene);
+        direct.step(0.0);
+
+        double previous = 1.0;
+        for (int order : {2, 6, 12}) {
+            Universe fmm;
+            fill(fmm, scene);
+            fmm.setSolver(NB::Solver::Fmm);
+            fmm.setFmmOrder(order);
+            fmm.step(0.0);
+            double error = relativeError(fmm, direct);
+            BOOST_TEST_MESSAGE("scene " << scene << ", order " << order
+                               << ": error " << error);
+            BOOST_TEST_CONTEXT("scene " << scene << ", order " << order) {
+                BOOST_CHECK_LT(error, previous);
+            }
+            previous = error;
+        }
+        BOOST_CHECK_LT(previous, 1e-7);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Universe_BarnesHut_Planets) {
+    Universe direct("planets.txt");
+    Universe tree("planets.txt");
+    tree.setSolver(NB::Solver::BarnesHut);
+    tree.setTheta(0.0);
+
+    direct.step(3600.0);
+    tree.step(3600.0);
+
+    BOOST_CHECK_LT(relativeError(tree, direct), 1e-5);
+}
+
+// Seen from the light body, the centre of mass of the root is farther
+// away than the root is wide, so a loose opening angle would accept the
+// root and pull the body by its own mass. Two bodies are always exact.
+BOOST_AUTO_TEST_CASE(QuadTree_NeverAcceptsOwnCell) {
+    NB::BodyState state;
+    state.push(1.0e24, 0.0, 0.0, 0.0, 0.0);
+    state.push(3.0e24, 1.0e11, 1.0e11, 0.0, 0.0);
+    NB::QuadTree tree;
+    tree.build(state);
+
+    const double pull = G * 3.0e24 / 2.0e22 / std::sqrt(2.0);
+    for (double theta : {0.5, 1.0, 1.5, 3.0}) {
+        double ax, ay;
+        tree.acceleration(state, 0, theta, 0.0, &ax, &ay);
+        BOOST_TEST_CONTEXT("theta " << theta) {
+            BOOST_CHECK_CLOSE(ax, pull, 1e-10);
+            BOOST_CHECK_CLOSE(ay, pull, 1e-10);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Universe_BarnesHut_ReusesNodePool) {
+    Universe universe;
+    makeCluster(universe, 500, 3);
+    universe.setSolver(NB::Solver::BarnesHut);
+
+    NB::QuadTree tree;
+    tree.build(universe.state());
+    const NB::QuadTree::Node* pool = tree.nodes().data();
+    size_t count = tree.nodeCount();
+    tree.build(universe.state());
+
+    double total = 0.0;
+    for (double mass : universe.state().mass) {
+        total += mass;
+    }
+
+    BOOST_CHECK(tree.nodes().data() == pool);
+    BOOST_CHECK_EQUAL(tree.nodeCount(), count);
+    BOOST_CHECK_CLOSE(tree.nodes()[0].mass, total, 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(Universe_Threads_Reproducible) {
+    for (NB::Solver solver : {NB::Solver::Direct, NB::Solver::BarnesHut}) {
+        Universe serial;
+        Universe first;
+        Universe second;
+        makeCluster(serial, 1500, 11);
+        makeCluster(first, 1500, 11);
+        makeCluster(second, 1500, 11);
+        serial.setSolver(solver);
+        first.setSolver(solver);
+        second.setSolver(solver);
+        first.setThreads(4);
+        second.setThreads(4);
+        BOOST_CHECK_EQUAL(first.threads(), 4);
+
+        for (int k = 0; k < 3; k++) {
+            serial.step(3600.0);
+            first.step(3600.0);
+            second.step(3600.0);
+        }
+
+        std::ostringstream a;
+        std::ostringstream b;
+        a << first;
+        b << second;
+        BOOST_CHECK_EQUAL(a.str(), b.str());
+        BOOST_CHECK(first.state().ax == second.state().ax);
+        BOOST_CHECK_LT(relativeError(first, serial), 1e-12);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Universe_Direct_Symmetric) {
+    Universe universe;
+    makeCluster(universe, 600, 5);
+    universe.step(0.0);
+
+    const NB::BodyState& st = universe.state();
+    double error = 0.0;
+    double norm = 0.0;
+    double px = 0.0;
+    double py = 0.0;
+    double scale = 0.0;
+    for (size_t i = 0; i < st.size(); i++) {
+        double ax = 0.0;
+        double ay = 0.0;
+        for (size_t j = 0; j < st.size(); j++) {
+            if (i != j) {
+                double dx = static_cast<double>(st.x[j]) - st.x[i];
+                double dy = static_cast<double>(st.y[j]) - st.y[i];
+                double r = std::sqrt(dx * dx + dy * dy);
+                ax += G * st.mass[j] * dx / (r * r * r);
+                ay += G * st.mass[j] * dy / (r * r * r);
+            }
+        }
+        error += (ax - st.ax[i]) * (ax - st.ax[i])
+        + (ay - st.ay[i]) * (ay - st.ay[i]);
+        norm += ax * ax + ay * ay;
+        px += st.mass[i] * st.ax[i];
+        py += st.mass[i] * st.ay[i];
+        scale += st.mass[i] * std::sqrt(ax * ax + ay * ay);
+    }
+
+    BOOST_CHECK_LT(std::sqrt(error / norm), 1e-12);
+    // Equal and opposite forces: the net force on the system vanishes.
+    BOOST_CHECK_LT(std::sqrt(px * px + py * py) / scale, 1e-12);
+}
+
+BOOST_AUTO_TEST_CASE(ThreadPool_CoversRangeOnce) {
+    NB::ThreadPool pool(4);
+    std::vector<int> hits(10007, 0);
+    pool.parallelFor(0, hits.size(), 13, [&](size_t b, size_t e, size_t) {
+        for (size_t i = b; i < e; i++) {
+            hits[i]++;
+        }
+    });
+
+    for (int count : hits) {
+        BOOST_CHECK_EQUAL(count, 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Universe_Simd_MatchesScalar) {
+    std::vector<NB::SimdLevel> levels = {NB::SimdLevel::Scalar};
+    if (NB::detectSimdLevel() >= NB::SimdLevel::AVX2) {
+        levels.push_back(NB::SimdLevel::AVX2);
+    }
+    if (NB::detectSimdLevel() >= NB::SimdLevel::AVX512) {
+        levels.push_back(NB::SimdLevel::AVX512);
+    }
+
+    Universe planets("planets.txt");
+    Universe cluster;
+    makeCluster(cluster, 10000, 13);
+    planets.step(0.0);
+    cluster.step(0.0);
+
+    for (NB::SimdLevel level : levels) {
+        Universe simdPlanets("planets.txt");
+        Universe simdCluster;
+        makeCluster(simdCluster, 10000, 13);
+        for (Universe* u : {&simdPlanets, &simdCluster}) {
+            u->setSimd(true);
+            u->setSimdLevel(level);
+            u->step(0.0);
+        }
+
+        BOOST_TEST_INFO("level " << NB::simdLevelName(level));
+        BOOST_CHECK_LT(relativeError(simdPlanets, planets), 1e-10);
+        BOOST_CHECK_LT(relativeError(simdCluster, cluster), 1e-10);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Universe_DoublePrecisionState) {
+    std::istringstream is(
+"1\n"
+"2.5e11\n"
+"1.4960000001e+11 0 0 29800 5.974e24 earth.gif\n");
+    Universe universe;
+    is >> universe;
+
+    BOOST_CHECK_EQUAL(universe.state().x[0], 1.4960000001e+11);
+    BOOST_CHECK_EQUAL(universe[0].precisePosition().x, 1.4960000001e+11);
+}
+
+BOOST_AUTO_TEST_CASE(Universe_Integrators_EnergyDrift) {
+    // One year of planets.txt. The higher-order integrators take ten times
+    // fewer steps than Euler and must still drift less.
+    const double year = 3.15576e7;
+    Universe euler("planets.txt");
+    double initial = totalEnergy(euler);
+    for (int k = 0; k < 3650; k++) {
+        euler.step(year / 3650);
+    }
+    double eulerDrift = std::abs(totalEnergy(euler) / initial - 1);
+
+    for (NB::Integrator integrator : {NB::Integrator::Leapfrog,
+                                      NB::Integrator::Yoshida4,
+                                      NB::Integrator::RK4}) {
+        Universe universe("planets.txt");
+        universe.setIntegrator(integrator);
+        for (int k = 0; k < 365; k++) {
+            universe.step(year / 365);
+        }
+        double drift = std::abs(totalEnergy(universe) / initial - 1);
+        BOOST_TEST_INFO(NB::integratorName(integrator) << " drift " << drift
+                        << " vs euler " << eulerDrift);
+        BOOST_CHECK_LT(drift, eulerDrift);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Universe_Leapfrog_ReusesForces) {
+    Universe universe("planets.txt");
+    universe.setIntegrator(NB::Integrator::Leapfrog);
+    universe.step(3600.0);
+
+    // Moving a body through its handle invalidates the cached forces, so
+    // the next step must match a universe that starts from that state.
+    sf::Vector2<double> moved = universe[0].precisePosition();
+    moved.x += 1.0e9;
+    universe.list()[0]->setPrecisePosition(moved);
+
+    Universe fresh;
+    for (size_t i = 0; i < universe.size(); i++) {
+        auto body = std::make_shared<CelestialBody>();
+        body->setPreciseMass(universe[i].preciseMass());
+        body->setPrecisePosition(universe[i].precisePosition());
+        body->setPreciseVelocity(universe[i].preciseVelocity());
+        fresh.addToList(body);
+    }
+    fresh.setSize(universe.size());
+    fresh.setIntegrator(NB::Integrator::Leapfrog);
+
+    universe.step(3600.0);
+    fresh.step(3600.0);
+    BOOST_CHECK(universe.state().x == fresh.state().x);
+    BOOST_CHECK(universe.state().vy == fresh.state().vy);
+}
+
+BOOST_AUTO_TEST_CASE(Universe_BlockSteps) {
+    // Ten days of planets.txt. Mercury needs the finest steps; the sun and
+    // the outer planets do not, so the block scheme evaluates far fewer
+    // forces than leapfrog at the finest step and lands in the same place.
+    const double day = 86400.0;
+    const int levels = 8;
+    Universe block("planets.txt");
+    Universe fine("planets.txt");
+    block.setIntegrator(NB::Integrator::Block);
+    block.setBlockLevels(levels);
+    block.setBlockAccuracy(0.005);
+    fine.setIntegrator(NB::Integrator::Leapfrog);
+
+    for (int k = 0; k < 10; k++) {
+        block.step(day);
+        for (int t = 0; t < (1 << levels); t++) {
+            fine.step(day / (1 << levels));
+        }
+    }
+
+    const std::vector<uint8_t>& level = block.blockStepper().levels();
+    BOOST_CHECK_GT(level[2], level[1]);  // mercury finer than mars
+    BOOST_CHECK_LT(block.forceEvaluations() * 4, fine.forceEvaluations());
+
+    for (size_t i = 0; i < block.size(); i++) {
+        sf::Vector2<double> d = block[i].precisePosition()
+        - fine[i].precisePosition();
+        BOOST_CHECK_LT(std::hypot(d.x, d.y), 2.0e5);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CelestialBody_HeadlessSkipsTextures) {
+    CelestialBody::setLoadTextures(false);
+    std::istringstream input("1 2 3 4 5 no_such_image.gif");
+    CelestialBody body;
+    input >> body;
+    CelestialBody::setLoadTextures(true);
+
+    BOOST_CHECK_EQUAL(body.filename(), "no_such_image.gif");
+    BOOST_CHECK(body.sprite().getTexture() == nullptr);
+    BOOST_CHECK_CLOSE(body.mass(), 5.0, 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(CelestialBody_MissingImageReportsError) {
+    CelestialBody missing(1.0f, {0, 0}, {0, 0}, "no_such_image.gif");
+    BOOST_CHECK(!missing.hasTexture());
+    BOOST_CHECK(missing.sprite().getTexture() == nullptr);
+
+    std::istringstream input("1 2 3 4 5 no_such_image.gif");
+    CelestialBody body;
+    input >> body;
+    BOOST_CHECK(input.fail());
+    BOOST_CHECK(!body.hasTexture());
+
+    CelestialBody earth(1.0f, {0, 0}, {0, 0}, "earth.gif");
+    BOOST_CHECK(earth.hasTexture());
+}
+
+BOOST_AUTO_TEST_CASE(TextureCache_SharesTextures) {
+    NB::TextureCache::global().clear();
+    CelestialBody earth(1.0f, {0, 0}, {0, 0}, "earth.gif");
+    CelestialBody other(2.0f, {1, 1}, {0, 0}, "earth.gif");
+    CelestialBody mars(3.0f, {2, 2}, {0, 0}, "mars.gif");
+
+    BOOST_CHECK_EQUAL(NB::TextureCache::global().size(), 2);
+    BOOST_CHECK(earth.sprite().getTexture() == other.sprite().getTexture());
+    BOOST_CHECK(earth.sprite().getTexture() != mars.sprite().getTexture());
+    BOOST_CHECK(NB::TextureCache::global().get("no_such_image.gif")
+                == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(BatchRenderer_QuadsAndPoints) {
+    Universe universe("planets.txt");
+    NB::BatchRenderer renderer;
+    renderer.rebuild(universe.list());
+    float scale = 400 / universe.radius();
+    renderer.update(universe.state(), scale);
+
+    const sf::VertexArray& vertices = renderer.vertices();
+    BOOST_CHECK(!renderer.pointMode());
+    BOOST_CHECK_EQUAL(vertices.getVertexCount(), 4 * universe.size());
+    BOOST_CHECK_CLOSE(vertices[0].position.x,
+                      universe[0].position().x * scale, 1e-4);
+
+    renderer.setBodyScale(1e-3f);
+    renderer.update(universe.state(), scale);
+    BOOST_CHECK(renderer.pointMode());
+    BOOST_CHECK_EQUAL(renderer.vertices().getVertexCount(), universe.size());
+}
+
+BOOST_AUTO_TEST_CASE(Universe_Parse_Errors) {
+    CelestialBody::setLoadTextures(false);
+    Universe universe;
+    NB::ParseError error;
+
+    BOOST_CHECK(universe.load("2\n100\n\n 1 2 3 4 5 earth.gif\r\n"
+                              "+6 7e0 -8 9 1e1 mars.gif\ntrailing notes\n",
+                              &error));
+    BOOST_CHECK_EQUAL(universe.size(), 2);
+    BOOST_CHECK_EQUAL(universe[1].filename(), "mars.gif");
+    BOOST_CHECK_CLOSE(universe[1].preciseVelocity().x, -8.0, 1e-12);
+
+    BOOST_CHECK(!universe.load("2\n100\n1 2 3 4 5 earth.gif\n"
+                               "6 7 eight 9 10 mars.gif\n", &error));
+    BOOST_CHECK_EQUAL(error.line, 4);
+    BOOST_CHECK_EQUAL(error.describe(), "line 4: bad x velocity 'eight'");
+    BOOST_CHECK_EQUAL(universe.size(), 0);
+    BOOST_CHECK(universe.list().empty());
+
+    BOOST_CHECK(!universe.load("3\n100\n1 2 3 4 5 earth.gif\n", &error));
+    BOOST_CHECK_EQUAL(error.line, 3);
+    BOOST_CHECK(!universe.load("2\n100\n1 2 3 4 5\n", &error));
+    BOOST_CHECK_EQUAL(error.message, "missing image file name");
+    BOOST_CHECK(!universe.load("-1\n100\n", &error));
+    BOOST_CHECK_EQUAL(error.line, 1);
+
+    std::istringstream input("1\nbig\n1 2 3 4 5 earth.gif\n");
+    BOOST_CHECK(!(input >> universe));
+    BOOST_CHECK_EQUAL(universe.parseError().line, 2);
+    CelestialBody::setLoadTextures(true);
+
+    BOOST_CHECK_THROW(Universe("no_such_universe.txt"), NB::ParseException);
+}
+
+BOOST_AUTO_TEST_CASE(Snapshot_ResumeMatches) {
+    Universe straight("planets.txt");
+    straight.setIntegrator(NB::Integrator::Leapfrog);
+    for (int i = 0; i < 20; i++) {
+        straight.step(25000.0);
+    }
+
+    Universe first("planets.txt");
+    first.setIntegrator(NB::Integrator::Leapfrog);
+    for (int i = 0; i < 10; i++) {
+        first.step(25000.0);
+    }
+    std::string message;
+    BOOST_REQUIRE(first.saveSnapshot("test_snapshot.bin",
+                                     {250000.0, 10}, &message));
+
+    Universe resumed;
+    NB::SnapshotInfo info;
+    NB::ParseError error;
+    BOOST_REQUIRE(resumed.loadSnapshot("test_snapshot.bin", &info, &error));
+    BOOST_CHECK_EQUAL(info.steps, 10);
+    BOOST_CHECK_EQUAL(info.time, 250000.0);
+    BOOST_CHECK_EQUAL(resumed.size(), first.size());
+    BOOST_CHECK_EQUAL(resumed.radius(), first.radius());
+    NB::SnapshotReader reader;
+    BOOST_REQUIRE(reader.open("test_snapshot.bin", &error));
+    for (size_t i = 0; i < reader.size(); i++) {
+        BOOST_CHECK_EQUAL(reader.names()[reader.image(i)],
+                          first[i].filename());
+    }
+    resumed.setIntegrator(NB::Integrator::Leapfrog);
+    for (int i = 0; i < 10; i++) {
+        resumed.step(25000.0);
+    }
+
+    for (size_t i = 0; i < straight.size(); i++) {
+        BOOST_CHECK_EQUAL(resumed[i].filename(), straight[i].filename());
+        BOOST_CHECK(resumed[i].precisePosition()
+                    == straight[i].precisePosition());
+        BOOST_CHECK(resumed[i].preciseVelocity()
+                    == straight[i].preciseVelocity());
+        BOOST_CHECK_EQUAL(resumed[i].preciseMass(), straight[i].preciseMass());
+    }
+
+    BOOST_CHECK(!resumed.loadSnapshot("planets.txt", &info, &error));
+    BOOST_CHECK(error.message.find("not a snapshot") != std::string::npos);
+    BOOST_CHECK_EQUAL(resumed.size(), 0);
+    std::remove("test_snapshot.bin");
+}
+
+// Offsets chosen so that offset + size wraps around to a small number.
+BOOST_AUTO_TEST_CASE(Snapshot_CorruptHeader) {
+    Universe universe("planets.txt");
+    std::string message;
+    BOOST_REQUIRE(universe.saveSnapshot("test_snapshot.bin", {0.0, 0},
+                                        &message));
+    std::ifstream in("test_snapshot.bin", std::ios::binary);
+    const std::vector<char> good((std::istreambuf_iterator<char>(in)), {});
+    in.close();
+
+    const size_t fields[] = {offsetof(NB::SnapshotHeader, imageOffset),
+                             offsetof(NB::SnapshotHeader, namesOffset)};
+    for (size_t field : fields) {
+        std::vector<char> bytes = good;
+        uint64_t offset = ~uint64_t(0) - 7;
+        std::memcpy(bytes.data() + field, &offset, sizeof(offset));
+        std::ofstream out("test_snapshot.bin", std::ios::binary);
+        out.write(bytes.data(), bytes.size());
+        out.close();
+
+        Universe loaded;
+        NB::SnapshotInfo info;
+        NB::ParseError error;
+        BOOST_CHECK(!loaded.loadSnapshot("test_snapshot.bin", &info, &error));
+        BOOST_CHECK_NE(error.message.find("corrupt"), std::string::npos);
+        BOOST_CHECK_EQUAL(loaded.size(), 0);
+    }
+    std::remove("test_snapshot.bin");
+}
+
+BOOST_AUTO_TEST_CASE(TrajectoryRecorder_Formats) {
+    Universe universe("planets.txt");
+    NB::TrajectoryRecorder binary, csv;
+    std::string message;
+    binary.setStride(2);
+    binary.setBodies({4, 0});
+    binary.setBuffers(2);
+    BOOST_REQUIRE(binary.open("test_trajectory.bin",
+                              NB::trajectoryFormatFor("test_trajectory.bin"),
+                              universe.size(), &message));
+    csv.setStride(5);
+    BOOST_REQUIRE(csv.open("test_trajectory.csv",
+                           NB::trajectoryFormatFor("test_trajectory.csv"),
+                           universe.size(), &message));
+    for (uint64_t step = 0; step <= 10; step++) {
+        if (step > 0) {
+            universe.step(25000.0);
+        }
+        binary.record(universe.state(), step * 25000.0, step);
+        csv.record(universe.state(), step * 25000.0, step);
+    }
+    BOOST_CHECK(binary.close());
+    BOOST_CHECK(csv.close());
+    BOOST_CHECK_EQUAL(binary.framesRecorded(), 6);
+    BOOST_CHECK_EQUAL(csv.framesRecorded(), 3);
+
+    // Header, two indices, then six frames of time, step and 4 x 2 values.
+    std::ifstream in("test_trajectory.bin", std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), {});
+    const size_t header = 8 + 4 + 4 + 8 + 2 * 4;
+    const size_t frame = 8 + 8 + 8 * 8;
+    BOOST_REQUIRE_EQUAL(bytes.size(), header + 6 * frame);
+    uint32_t first;
+    uint64_t step;
+    double x;
+    std::memcpy(&first, bytes.data() + header - 8, sizeof(first));
+    std::memcpy(&step, bytes.data() + header + 5 * frame + 8, sizeof(step));
+    std::memcpy(&x, bytes.data() + header + 5 * frame + 16, sizeof(x));
+    BOOST_CHECK_EQUAL(first, 4);
+    BOOST_CHECK_EQUAL(step, 10);
+    BOOST_CHECK_EQUAL(x, universe[4].precisePosition().x);
+
+    std::ifstream text("test_trajectory.csv");
+    std::string line;
+    std::vector<std::string> lines;
+    while (std::getline(text, line)) {
+        lines.push_back(line);
+    }
+    BOOST_REQUIRE_EQUAL(lines.size(), 1 + 3 * universe.size());
+    BOOST_CHECK_EQUAL(lines[0], "step,time,body,x,y,vx,vy");
+    BOOST_CHECK(lines[1].rfind("0,0,0,", 0) == 0);
+
+    BOOST_CHECK(!binary.open("test_trajectory.bin",
+                             NB::TrajectoryFormat::Binary, 3, &message));
+    std::remove("test_trajectory.bin");
+    std::remove("test_trajectory.csv");
+}
+
+// Bodies 1 and 3 collide with body 2 between them in the list; 3 is
+// heavier and absorbs 1. The recording is by input index, through a
+// reorder, so only column 1 turns to NaN.
+BOOST_AUTO_TEST_CASE(TrajectoryRecorder_MergedBodies) {
+    CelestialBody::setLoadTextures(false);
+    struct Spec { double m, x, y; const char* image; };
+    const Spec specs[] = {
+        {1.0e20, -1.0e11, 0.0, "comet.gif"},
+        {2.0e24, 0.0, 0.0, "moon.gif"},
+        {1.0e20, 5.0e10, 5.0e10, "mars.gif"},
+        {6.0e24, 1.0e6, 0.0, "earth.gif"},
+        {1.0e20, 1.0e11, -1.0e11, "venus.gif"},
+    };
+    Universe universe;
+    universe.setRadius(2.0e11);
+    for (const Spec& spec : specs) {
+        auto body = std::make_shared<CelestialBody>();
+        body->setPreciseMass(spec.m);
+        body->setPrecisePosition({spec.x, spec.y});
+        body->setFileName(spec.image);
+        universe.addToList(body);
+    }
+    universe.setSize(5);
+    universe.setCollisions(true);
+    universe.setReorderInterval(1);
+
+    NB::TrajectoryRecorder recorder;
+    std::string message;
+    BOOST_REQUIRE(recorder.open("test_merged.bin",
+                                NB::TrajectoryFormat::Binary,
+                                universe.size(), &message));
+    recorder.record(universe.state(), 0.0, 0, &universe.inputSlots());
+    for (uint64_t step = 1; step <= 3; step++) {
+        universe.step(1.0);
+        recorder.record(universe.state(), step * 1.0, step,
+                        &universe.inputSlots());
+    }
+    BOOST_CHECK(recorder.close());
+    CelestialBody::setLoadTextures(true);
+
+    BOOST_REQUIRE_EQUAL(universe.merges(), 1);
+    const char* order[] = {"comet.gif", "mars.gif", "earth.gif",
+                           "venus.gif"};
+    BOOST_REQUIRE_EQUAL(universe.size(), 4);
+    for (size_t i = 0; i < 4; i++) {
+        BOOST_CHECK_EQUAL(universe[i].filename(), order[i]);
+    }
+    const std::vector<uint32_t>& slots = universe.inputSlots();
+    BOOST_REQUIRE_EQUAL(slots.size(), 5);
+    BOOST_CHECK_EQUAL(slots[1], NB::kNoSlot);
+
+    std::ifstream in("test_merged.bin", std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), {});
+    const size_t header = 8 + 4 + 4 + 8 + 5 * 4;
+    const size_t frame = 8 + 8 + 4 * 5 * 8;
+    BOOST_REQUIRE_EQUAL(bytes.size(), header + 4 * frame);
+    auto x = [&](size_t f, size_t body) {
+        double value;
+        std::memcpy(&value, bytes.data() + header + f * frame + 16
+                    + body * 8, sizeof(value));
+        return value;
+    };
+    BOOST_CHECK_EQUAL(x(0, 1), 0.0);
+    for (size_t f = 1; f < 4; f++) {
+        for (size_t body = 0; body < 5; body++) {
+            BOOST_CHECK_EQUAL(std::isnan(x(f, body)), body == 1);
+        }
+    }
+    const size_t survivors[] = {0, 2, 3, 4};
+    for (size_t i = 0; i < 4; i++) {
+        BOOST_CHECK_EQUAL(x(3, survivors[i]),
+                          universe[i].precisePosition().x);
+    }
+    std::remove("test_merged.bin");
+}
+
+BOOST_AUTO_TEST_CASE(Profiler_PhasesAndCounters) {
+    Universe universe;
+    makeCluster(universe, 500, 11);
+    universe.setSolver(NB::Solver::BarnesHut);
+
+    NB::Profiler::reset();
+    universe.step(1.0);
+    BOOST_CHECK_EQUAL(NB::Profiler::calls(NB::Phase::Step), 0);
+
+    NB::Profiler::setTracing(true, 16);
+    for (int i = 0; i < 10; i++) {
+        universe.step(1.0);
+    }
+    auto boxed = std::make_unique<double>(1.0);
+    NB::Profiler::setEnabled(false);
+    NB::Profiler::setTracing(false);
+
+    BOOST_CHECK_EQUAL(NB::Profiler::value(NB::Metric::Steps), 10);
+    BOOST_CHECK_EQUAL(NB::Profiler::calls(NB::Phase::Step), 10);
+    BOOST_CHECK_EQUAL(NB::Profiler::calls(NB::Phase::Forces), 10);
+    BOOST_CHECK_EQUAL(NB::Profiler::calls(NB::Phase::TreeBuild), 10);
+    BOOST_CHECK_GE(NB::Profiler::total(NB::Phase::Step),
+                   NB::Profiler::total(NB::Phase::Forces));
+    uint64_t interactions = NB::Profiler::value(NB::Metric::Interactions);
+    BOOST_CHECK_GT(interactions, 0);
+    BOOST_CHECK_LT(interactions, 10 * 500 * 499);
+    BOOST_CHECK_GT(NB::Profiler::value(NB::Metric::NodesVisited), 0);
+    BOOST_CHECK_GE(NB::Profiler::value(NB::Metric::Allocations), 1);
+
+    std::string message;
+    BOOST_REQUIRE(NB::Profiler::writeTrace("test_trace.json", &message));
+    std::ifstream in("test_trace.json");
+    std::string trace((std::istreambuf_iterator<char>(in)), {});
+    BOOST_CHECK_EQUAL(trace.rfind("{\"displayTimeUnit\":\"ms\"", 0), 0);
+    BOOST_CHECK(trace.find("\"name\":\"forces\",\"ph\":\"X\"")
+                != std::string::npos);
+    std::ostringstream summary;
+    NB::Profiler::printSummary(summary);
+    BOOST_CHECK(summary.str().find("trace events dropped")
+                != std::string::npos);
+    NB::Profiler::reset();
+    std::remove("test_trace.json");
+}
+
+BOOST_AUTO_TEST_CASE(Step_AllocationFree) {
+    const NB::Integrator integrators[] = {
+        NB::Integrator::Euler, NB::Integrator::Leapfrog,
+        NB::Integrator::Yoshida4, NB::Integrator::RK4, NB::Integrator::Block
+    };
+    const NB::Solver solvers[] = {
+        NB::Solver::Direct, NB::Solver::BarnesHut, NB::Solver::Fmm
+    };
+    for (NB::Solver solver : solvers) {
+        for (NB::Integrator integrator : integrators) {
+            for (size_t threads : {1, 3}) {
+                Universe universe;
+                makeCluster(universe, 300, 5);
+                universe.setSolver(solver);
+                universe.setIntegrator(integrator);
+                universe.setBlockLevels(3);
+                universe.setThreads(threads);
+                universe.setCollisions(true);
+                universe.setReorderInterval(7);
+                universe.setDiagnosticsInterval(5);
+                universe.step(1.0);  // warm-up sizes the scratch buffers
+                universe.reorder();
+                universe.measureConservation();
+
+                NB::Profiler::reset();
+                NB::Profiler::setEnabled(true);
+                for (int i = 0; i < 1000; i++) {
+                    universe.step(1.0);
+                }
+                NB::Profiler::setEnabled(false);
+                BOOST_TEST_CONTEXT("solver " << static_cast<int>(solver)
+                                   << ", " << NB::integratorName(integrator)
+                                   << ", " << threads << " threads") {
+                    BOOST_CHECK_EQUAL(
+                        NB::Profiler::value(NB::Metric::Allocations), 0);
+                }
+            }
+        }
+    }
+    NB::Profiler::reset();
+}
+
+BOOST_AUTO_TEST_CASE(Scenario_Generators) {
+    NB::ScenarioOptions options;
+    options.count = 2000;
+    options.seed = 7;
+    NB::Scenario a, b, c;
+    std::string message;
+    BOOST_REQUIRE(NB::generateScenario(options, &a, &message));
+    BOOST_REQUIRE(NB::generateScenario(options, &b, &message));
+    options.seed = 8;
+    BOOST_REQUIRE(NB::generateScenario(options, &c, &message));
+    BOOST_CHECK_EQUAL(a.state.size(), 2000);
+    BOOST_CHECK(a.state.x == b.state.x && a.state.vy == b.state.vy);
+    BOOST_CHECK(a.state.x != c.state.x);
+    double mass = 0, momentum = 0;
+    for (size_t i = 0; i < a.state.size(); i++) {
+        mass += a.state.mass[i];
+        momentum += a.state.mass[i] * a.state.vx[i];
+    }
+    BOOST_CHECK_SMALL(momentum / mass, 1e-6);
+
+    // The text output reads back into exactly the same state.
+    std::FILE* file = std::tmpfile();
+    BOOST_REQUIRE(NB::writeScenarioText(a, file));
+    std::rewind(file);
+    std::string text;
+    char chunk[4096];
+    for (size_t got; (got = std::fread(chunk, 1, sizeof(chunk), file)) > 0;) {
+        text.append(chunk, got);
+    }
+    std::fclose(file);
+    CelestialBody::setLoadTextures(false);
+    Universe universe;
+    NB::ParseError error;
+    BOOST_REQUIRE(universe.load(text, &error));
+    CelestialBody::setLoadTextures(true);
+    BOOST_CHECK_EQUAL(universe.radius(), a.radius);
+    BOOST_CHECK(universe.state().x == a.state.x);
+    BOOST_CHECK(universe.state().vy == a.state.vy);
+    BOOST_CHECK(universe.state().mass == a.state.mass);
+    BOOST_CHECK_EQUAL(universe[0].filename(), "sun.gif");
+
+    options.kind = NB::ScenarioKind::Belt;
+    options.count = 100;
+    BOOST_REQUIRE(NB::generateScenario(options, &a, &message));
+    BOOST_REQUIRE_EQUAL(a.state.size(), 105);
+    const double au = 1.495978707e11;
+    for (size_t i = 5; i < a.state.size(); i++) {
+        double r = std::hypot(a.state.x[i] - a.state.x[3],
+                              a.state.y[i] - a.state.y[3]);
+        BOOST_CHECK(r >= 2.2 * au && r <= 3.3 * au);
+    }
+    BOOST_CHECK_EQUAL(a.names[a.images[3]], "sun.gif");
+    BOOST_CHECK_EQUAL(a.names[a.images[5]], "comet.gif");
+
+    options.kind = NB::ScenarioKind::Galaxies;
+    options.count = 1001;
+    BOOST_REQUIRE(NB::generateScenario(options, &a, &message));
+    BOOST_CHECK_EQUAL(a.state.size(), 1001);
+
+    options.kind = NB::ScenarioKind::Belt;
+    options.base = "no_such_universe.txt";
+    BOOST_CHECK(!NB::generateScenario(options, &a, &message));
+
+    // A header count far past the file is an error, not a huge allocation.
+    {
+        std::ofstream out("test_bad_base.txt");
+        out << "99999999999999\n1e11\n0 0 0 0 2e30 sun.gif\n";
+    }
+    options.base = "test_bad_base.txt";
+    BOOST_CHECK(!NB::generateScenario(options, &a, &message));
+    BOOST_CHECK_NE(message.find("more bodies"), std::string::npos);
+    std::remove("test_bad_base.txt");
+}
+
+BOOST_AUTO_TEST_CASE(Softening_AllSolvers) {
+    // Two coincident bodies and a third 3e9 m away, with eps = 1e9 m.
+    const double eps = 1.0e9;
+    const double masses[] = {2.0e24, 3.0e24, 5.0e24};
+    const double xs[] = {0.0, 0.0, 3.0e9};
+    const double far = 3.0e9;
+    const double expected = 6.67430e-11 * (masses[0] + masses[1]) * far
+                          / std::pow(far * far + eps * eps, 1.5);
+
+    for (int variant = 0; variant < 4; variant++) {
+        Universe universe;
+        universe.setRadius(1.0e10);
+        for (size_t i = 0; i < 3; i++) {
+            auto body = std::make_shared<CelestialBody>();
+            body->setPreciseMass(masses[i]);
+            body->setPrecisePosition({xs[i], 0.0});
+            universe.addToList(body);
+        }
+        universe.setSize(3);
+        universe.setSoftening(eps);
+        if (variant == 1) {
+            universe.setSimd(true);
+        } else if (variant == 2) {
+            universe.setSolver(NB::Solver::BarnesHut);
+        } else if (variant == 3) {
+            universe.setIntegrator(NB::Integrator::Block);
+        }
+        universe.step(1.0);
+
+        const NB::BodyState& st = universe.state();
+        BOOST_TEST_CONTEXT("variant " << variant) {
+            for (size_t i = 0; i < 3; i++) {
+                BOOST_CHECK(std::isfinite(st.ax[i]) && st.ay[i] == 0.0);
+            }
+            BOOST_CHECK_CLOSE(-st.ax[2], expected, 1e-9);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Collisions_MergeConservesMomentum) {
+    CelestialBody::setLoadTextures(false);
+    struct Spec { double m, x, vx, vy; const char* image; };
+    const Spec specs[] = {
+        {2.0e24, 0.0, 1000.0, 0.0, "moon.gif"},
+        {6.0e24, 1.0e6, -3000.0, 500.0, "earth.gif"},
+        {1.0e20, 1.0e11, 0.0, 0.0, "comet.gif"},
+    };
+    Universe universe;
+    universe.setRadius(2.0e11);
+    std::vector<std::shared_ptr<CelestialBody>> bodies;
+    for (const Spec& spec : specs) {
+        auto body = std::make_shared<CelestialBody>();
+        body->setPreciseMass(spec.m);
+        body->setPrecisePosition({spec.x, 0.0});
+        body->setPreciseVelocity({spec.vx, spec.vy});
+        body->setFileName(spec.image);
+        universe.addToList(body);
+        bodies.push_back(body);
+    }
+    universe.setSize(3);
+    universe.setCollisions(true);
+
+    auto momentum = [&](double* px, double* py, double* mass) {
+        const NB::BodyState& st = universe.state();
+        *px = *py = *mass = 0.0;
+        for (size_t i = 0; i < st.size(); i++) {
+            *px += st.mass[i] * st.vx[i];
+            *py += st.mass[i] * st.vy[i];
+            *mass += st.mass[i];
+        }
+    };
+    double px0, py0, m0, px1, py1, m1;
+    momentum(&px0, &py0, &m0);
+    universe.step(1.0);
+    momentum(&px1, &py1, &m1);
+    CelestialBody::setLoadTextures(true);
+
+    BOOST_REQUIRE_EQUAL(universe.size(), 2);
+    BOOST_REQUIRE_EQUAL(universe.list().size(), 2);
+    BOOST_CHECK_EQUAL(universe.merges(), 1);
+    BOOST_CHECK_CLOSE(m1, m0, 1e-12);
+    BOOST_CHECK_CLOSE(px1, px0, 1e-6);
+    BOOST_CHECK_CLOSE(py1, py0, 1e-6);
+    // The heavier body survives in the lower slot; the other is detached.
+    BOOST_CHECK_EQUAL(universe[0].filename(), "earth.gif");
+    BOOST_CHECK_CLOSE(universe[0].preciseMass(), 8.0e24, 1e-12);
+    BOOST_CHECK_EQUAL(universe[1].filename(), "comet.gif");
+    BOOST_CHECK_EQUAL(universe[1].index(), 1);
+    BOOST_CHECK(!bodies[0]->isBound());
+    BOOST_CHECK_EQUAL(bodies[0]->preciseMass(), 2.0e24);
+}
+
+BOOST_AUTO_TEST_CASE(CollisionGrid_MatchesBruteForce) {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> coord(-2.0e8, 2.0e8);
+    std::uniform_real_distribution<double> mass(1.0e20, 1.0e24);
+    NB::BodyState state;
+    for (size_t i = 0; i < 1500; i++) {
+        state.push(mass(rng), coord(rng), coord(rng), 0.0, 0.0);
+    }
+    const double density = 5500.0;
+
+    NB::CollisionGrid grid;
+    for (int round = 0; round < 3; round++) {
+        std::vector<NB::CollisionGrid::Pair> brute;
+        for (uint32_t i = 0; i < state.size(); i++) {
+            for (uint32_t j = i + 1; j < state.size(); j++) {
+                double reach =
+                    NB::CollisionGrid::radiusFor(state.mass[i], density)
+                    + NB::CollisionGrid::radiusFor(state.mass[j], density);
+                double dx = state.x[j] - state.x[i];
+                double dy = state.y[j] - state.y[i];
+                if (dx * dx + dy * dy < reach * reach) {
+                    brute.emplace_back(i, j);
+                }
+            }
+        }
+        auto found = grid.overlaps(state, density);
+        std::sort(found.begin(), found.end());
+        BOOST_TEST_CONTEXT("round " << round) {
+            BOOST_CHECK_GT(brute.size(), 0);
+            BOOST_CHECK(found == brute);
+        }
+        // Round 1 reuses the previous binning; round 2 moves every body.
+        double shift = round == 0 ? 0.0 : 3.0e7;
+        for (size_t i = 0; i < state.size(); i++) {
+            state.x[i] += shift;
+        }
+    }
+    BOOST_CHECK_EQUAL(grid.rebuilds(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(FrameExchange_NoTearing) {
+    NB::FrameExchange exchange;
+    const size_t n = 1000;
+    const uint64_t frames = 20000;
+    std::thread writer([&] {
+        for (uint64_t k = 1; k <= frames; k++) {
+            NB::FrameExchange::Frame& frame = exchange.back();
+            frame.x.assign(n, static_cast<double>(k));
+            frame.y.assign(n, -static_cast<double>(k));
+            frame.time = static_cast<double>(k);
+            frame.steps = k;
+            exchange.publish();
+        }
+    });
+
+    // Every frame the reader takes is whole and newer than the last.
+    uint64_t last = 0;
+    size_t received = 0, torn = 0, stale = 0;
+    while (last < frames) {
+        if (!exchange.acquire()) {
+            std::this_thread::yield();
+            continue;
+        }
+        const NB::FrameExchange::Frame& frame = exchange.latest();
+        const double k = static_cast<double>(frame.steps);
+        for (size_t i = 0; i < n; i++) {
+            torn += frame.x[i] != k || frame.y[i] != -k;
+        }
+        stale += frame.steps <= last;
+        last = frame.steps;
+        received++;
+    }
+    writer.join();
+    BOOST_CHECK_EQUAL(torn, 0);
+    BOOST_CHECK_EQUAL(stale, 0);
+    BOOST_CHECK_GT(received, 0);
+    BOOST_CHECK_EQUAL(exchange.published(), frames);
+    BOOST_CHECK(!exchange.acquire());
+}
+
+BOOST_AUTO_TEST_CASE(FrameExchange_Blend) {
+    NB::FrameExchange exchange;
+    NB::BodyState shown;
+    for (double x : {0.0, 10.0}) {
+        NB::FrameExchange::Frame& frame = exchange.back();
+        frame.x.assign(3, x);
+        frame.y.assign(3, -x);
+        frame.time = x / 10;
+        exchange.publish();
+        BOOST_REQUIRE(exchange.acquire());
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    const uint64_t a = exchange.previous().stamp;
+    const uint64_t b = exchange.latest().stamp;
+    BOOST_REQUIRE_GT(b, a);
+
+    BOOST_CHECK_EQUAL(exchange.blend(b, &shown), 0.0);
+    BOOST_CHECK_EQUAL(shown.x[2], 0.0);
+    BOOST_CHECK_CLOSE(exchange.blend(b + (b - a) / 2, &shown), 0.5, 1e-3);
+    BOOST_CHECK_CLOSE(shown.x[1], 5.0, 1e-3);
+    BOOST_CHECK_CLOSE(shown.y[1], -5.0, 1e-3);
+    BOOST_CHECK_EQUAL(exchange.blend(b + 10 * (b - a), &shown), 1.0);
+    BOOST_CHECK_EQUAL(shown.size(), 3);
+    BOOST_CHECK_EQUAL(shown.x[0], 10.0);
+}
+
+// Every kernel variant agrees with the double, unsoftened one: exactly for
+// zero softening and the integrator policies, closely in float.
+BOOST_AUTO_TEST_CASE(Universe_KernelVariants) {
+    Universe reference;
+    makeCluster(reference, 1500, 21);
+    reference.step(0.0);
+
+    Universe precise;
+    makeCluster(precise, 1500, 21);
+    precise.setSoftening(0.0);
+    precise.step(0.0);
+    BOOST_CHECK(precise.state().ax == reference.state().ax);
+
+    for (size_t threads : {1, 3}) {
+        Universe fast;
+        makeCluster(fast, 1500, 21);
+        fast.setPrecision(NB::Precision::Float);
+        fast.setThreads(threads);
+        fast.step(0.0);
+        BOOST_TEST_CONTEXT(threads << " threads") {
+            BOOST_CHECK_LT(relativeError(fast, reference), 1e-4);
+            BOOST_CHECK_GT(relativeError(fast, reference), 0.0);
+        }
+    }
+
+    // A softening far below the spacing barely moves the float result.
+    Universe soft;
+    makeCluster(soft, 1500, 21);
+    soft.setPrecision(NB::Precision::Float);
+    soft.setSoftening(1.0e3);
+    soft.step(0.0);
+    BOOST_CHECK_LT(relativeError(soft, reference), 1e-4);
+
+    // Leapfrog through its policy is still time-reversible.
+    Universe leapfrog;
+    makeCluster(leapfrog, 200, 4);
+    leapfrog.setIntegrator(NB::Integrator::Leapfrog);
+    const std::vector<double> x0(leapfrog.state().x.begin(),
+                                 leapfrog.state().x.end());
+    for (int k = 0; k < 50; k++) {
+        leapfrog.step(3600.0);
+    }
+    for (int k = 0; k < 50; k++) {
+        leapfrog.step(-3600.0);
+    }
+    for (size_t i = 0; i < x0.size(); i++) {
+        BOOST_CHECK_SMALL(leapfrog.state().x[i] - x0[i], 1.0);
+    }
+}
+
+// Member 0 follows a Universe exactly, the others drift apart, and each
+// member is the same whatever the ensemble size and thread count.
+BOOST_AUTO_TEST_CASE(Ensemble_MatchesUniverse) {
+    for (NB::Integrator integrator :
+         {NB::Integrator::Euler, NB::Integrator::Leapfrog}) {
+        Universe universe;
+        makeCluster(universe, 100, 17);
+        universe.setIntegrator(integrator);
+
+        NB::Ensemble small, large;
+        small.reset(universe.state(), 11, 1e-3, 42);
+        large.reset(universe.state(), 20, 1e-3, 42);
+        BOOST_REQUIRE(small.setIntegrator(integrator));
+        BOOST_REQUIRE(large.setIntegrator(integrator));
+        NB::ThreadPool pool(3);
+        for (int k = 0; k < 20; k++) {
+            universe.step(3600.0);
+            small.step(3600.0, nullptr);
+        }
+        large.run(3600.0, 20, &pool);
+
+        NB::BodyState a, b;
+        small.member(0, &a);
+        BOOST_CHECK(a.x == universe.state().x);
+        BOOST_CHECK(a.vy == universe.state().vy);
+
+        small.member(5, &a);
+        large.member(5, &b);
+        BOOST_CHECK(a.x == b.x);
+        BOOST_CHECK(a.vx == b.vx);
+        BOOST_CHECK(a.x != universe.state().x);
+    }
+
+    NB::Ensemble ensemble;
+    BOOST_CHECK(!ensemble.setIntegrator(NB::Integrator::RK4));
+}
+
+// A rank that owns the left half of a cluster and receives the essential
+// points of the right half's tree gets forces as good as one tree over
+// everything, from far fewer points than the right half has bodies.
+BOOST_AUTO_TEST_CASE(Decomposition_EssentialPoints) {
+    Universe direct;
+    makeCluster(direct, 4000, 29);
+    direct.step(0.0);
+    const NB::BodyState& all = direct.state();
+
+    NB::BodyState left, right;
+    for (size_t i = 0; i < all.size(); i++) {
+        NB::BodyState& side = all.x[i] < 0 ? left : right;
+        side.push(all.mass[i], all.x[i], all.y[i], 0.0, 0.0);
+    }
+    NB::QuadTree rightTree;
+    rightTree.build(right);
+    std::vector<NB::PointMass> points;
+    NB::essentialPoints(rightTree, NB::boundingDomain(left), 0.5, &points);
+    BOOST_CHECK_GT(points.size(), 0u);
+    BOOST_CHECK_LT(points.size(), right.size() / 2);
+
+    double mass = 0.0;
+    for (const NB::PointMass& p : points) {
+        mass += p.mass;
+    }
+    double rightMass = 0.0;
+    for (size_t i = 0; i < right.size(); i++) {
+        rightMass += right.mass[i];
+    }
+    BOOST_CHECK_CLOSE(mass, rightMass, 1e-9);
+
+    NB::BodyState combined = left;
+    for (const NB::PointMass& p : points) {
+        combined.push(p.mass, p.x, p.y, 0.0, 0.0);
+    }
+    NB::QuadTree tree;
+    tree.build(combined);
+    double error = 0.0, norm = 0.0;
+    size_t k = 0;
+    for (size_t i = 0; i < all.size(); i++) {
+        if (all.x[i] >= 0) {
+            continue;
+        }
+        double ax, ay;
+        tree.acceleration(combined, k++, 0.5, 0.0, &ax, &ay);
+        error += (ax - all.ax[i]) * (ax - all.ax[i]) +
+                 (ay - all.ay[i]) * (ay - all.ay[i]);
+        norm += all.ax[i] * all.ax[i] + all.ay[i] * all.ay[i];
+    }
+    BOOST_CHECK_LT(std::sqrt(error / norm), 1e-2);
+}
+
+BOOST_AUTO_TEST_CASE(Decomposition_OwningDomain) {
+    std::vector<NB::Domain> domains = {
+        {0.0, 0.0, 1.0, 1.0}, {1.0, 0.0, 2.0, 1.0}, {}, {0.0, 1.0, 2.0, 2.0}};
+    BOOST_CHECK_EQUAL(NB::owningDomain(domains, 0.5, 0.5), 0u);
+    BOOST_CHECK_EQUAL(NB::owningDomain(domains, 1.0, 0.5), 1u);
+    BOOST_CHECK_EQUAL(NB::owningDomain(domains, 1.5, 1.0), 3u);
+    // Outside every domain: the nearest one, never the empty one.
+    BOOST_CHECK_EQUAL(NB::owningDomain(domains, 2.5, 0.2), 1u);
+    BOOST_CHECK_EQUAL(NB::owningDomain(domains, -3.0, 1.9), 3u);
+    BOOST_CHECK(domains[2].empty());
+    BOOST_CHECK_EQUAL(domains[0].distance2(2.0, 2.0), 2.0);
+}
+
+BOOST_AUTO_TEST_CASE(SpaceFillingCurve_Hilbert) {
+    // The order-2 curve through the 4x4 grid, as (x, y), in the top bits.
+    const uint32_t q = 1u << 30;
+    const uint32_t path[16][2] = {
+        {0, 0}, {1, 0}, {1, 1}, {0, 1}, {0, 2}, {0, 3}, {1, 3}, {1, 2},
+        {2, 2}, {2, 3}, {3, 3}, {3, 2}, {3, 1}, {2, 1}, {2, 0}, {3, 0}};
+    uint64_t previous = 0;
+    for (int k = 0; k < 16; k++) {
+        uint64_t key = NB::hilbertKey(path[k][0] * q, path[k][1] * q);
+        BOOST_CHECK_EQUAL(key >> 60, static_cast<uint64_t>(k));
+        BOOST_CHECK(k == 0 || key > previous);
+        previous = key;
+    }
+    // Every step along the curve moves to a neighbouring cell.
+    uint32_t lastX = 0, lastY = 0;
+    std::vector<std::pair<uint64_t, std::pair<uint32_t, uint32_t>>> cells;
+    for (uint32_t x = 0; x < 32; x++) {
+        for (uint32_t y = 0; y < 32; y++) {
+            cells.push_back({NB::hilbertKey(x << 27, y << 27), {x, y}});
+        }
+    }
+    std::sort(cells.begin(), cells.end());
+    for (size_t k = 0; k < cells.size(); k++) {
+        auto [x, y] = cells[k].second;
+        if (k > 0) {
+            BOOST_CHECK_EQUAL(std::abs(int(x) - int(lastX)) +
+                              std::abs(int(y) - int(lastY)), 1);
+        }
+        lastX = x;
+        lastY = y;
+    }
+}
+
+// Reordering moves the arrays but not the bodies: the list, operator[],
+// the output and the physics are what they were.
+BOOST_AUTO_TEST_CASE(Universe_Reorder) {
+    Universe plain, sorted;
+    makeCluster(plain, 2000, 31);
+    makeCluster(sorted, 2000, 31);
+    for (Universe* universe : {&plain, &sorted}) {
+        universe->setSolver(NB::Solver::BarnesHut);
+        universe->setCollisions(true);
+        universe->setCollisionDensity(1.0);
+    }
+    sorted.setReorderInterval(3);
+    for (int k = 0; k < 20; k++) {
+        plain.step(3600.0);
+        sorted.step(3600.0);
+    }
+    BOOST_CHECK_GT(plain.merges(), 0u);
+    BOOST_REQUIRE_EQUAL(plain.size(), sorted.size());
+
+    std::vector<uint32_t> slots = sorted.slots();
+    std::sort(slots.begin(), slots.end());
+    for (size_t i = 0; i < slots.size(); i++) {
+        BOOST_REQUIRE_EQUAL(slots[i], i);
+    }
+    bool moved = false;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        moved = moved || sorted.slots()[i] != i;
+        BOOST_CHECK_EQUAL(sorted[i].filename(), plain[i].filename());
+        BOOST_CHECK_EQUAL(sorted[i].preciseMass(), plain[i].preciseMass());
+        BOOST_CHECK_CLOSE(sorted[i].precisePosition().x,
+                          plain[i].precisePosition().x, 1e-6);
+        BOOST_CHECK_EQUAL(sorted.state().x[sorted.slots()[i]],
+                          sorted[i].precisePosition().x);
+    }
+    BOOST_CHECK(moved);
+}
+
+// The potential energy from every force path against the direct double
+// sum in totalEnergy, and the momenta against a sum over the bodies.
+BOOST_AUTO_TEST_CASE(Universe_Conservation) {
+    struct Variant {
+        const char* name;
+        NB::Solver solver;
+        NB::Integrator integrator;
+        size_t threads;
+        bool simd;
+        NB::Precision precision;
+        double tolerance;  // relative potential error
+    } variants[] = {
+        {"direct", NB::Solver::Direct, NB::Integrator::Euler, 1, false,
+         NB::Precision::Double, 1e-12},
+        {"threads", NB::Solver::Direct, NB::Integrator::Leapfrog, 3, false,
+         NB::Precision::Double, 1e-12},
+        {"float", NB::Solver::Direct, NB::Integrator::Euler, 1, false,
+         NB::Precision::Float, 1e-4},
+        {"simd", NB::Solver::Direct, NB::Integrator::Euler, 1, true,
+         NB::Precision::Double, 1e-12},
+        {"yoshida", NB::Solver::Direct, NB::Integrator::Yoshida4, 1, false,
+         NB::Precision::Double, 1e-12},
+        {"block", NB::Solver::BarnesHut, NB::Integrator::Block, 1, false,
+         NB::Precision::Double, 1e-12},
+        {"barnes-hut", NB::Solver::BarnesHut, NB::Integrator::RK4, 3, false,
+         NB::Precision::Double, 1e-2},
+        {"fmm", NB::Solver::Fmm, NB::Integrator::Yoshida4, 1, false,
+         NB::Precision::Double, 1e-2},
+    };
+    for (const Variant& v : variants) {
+        Universe universe;
+        makeCluster(universe, 700, 17);
+        universe.setSolver(v.solver);
+        universe.setIntegrator(v.integrator);
+        universe.setThreads(v.threads);
+        universe.setSimd(v.simd);
+        universe.setPrecision(v.precision);
+        universe.setDiagnosticsInterval(3);
+        for (int k = 0; k < 6; k++) {
+            universe.step(1e4);
+            BOOST_CHECK_EQUAL(universe.measured(), k % 3 == 2);
+        }
+
+        const NB::Conservation& c = universe.conservation();
+        const NB::BodyState& st = universe.state();
+        double kinetic = 0.0, px = 0.0, angular = 0.0;
+        for (size_t i = 0; i < st.size(); i++) {
+            kinetic += 0.5 * st.mass[i] *
+                (st.vx[i] * st.vx[i] + st.vy[i] * st.vy[i]);
+            px += st.mass[i] * st.vx[i];
+            angular += st.mass[i] * (st.x[i] * st.vy[i] - st.y[i] * st.vx[i]);
+        }
+        BOOST_TEST_CONTEXT(v.name) {
+            BOOST_CHECK_GT(kinetic, 0.0);
+            BOOST_CHECK_CLOSE(c.kinetic, kinetic, 1e-10);
+            BOOST_CHECK_SMALL(c.px - px, 1e-12 * c.momentumScale);
+            BOOST_CHECK_SMALL(c.angular - angular, 1e-12 * c.angularScale);
+            double potential = totalEnergy(universe) - kinetic;
+            BOOST_CHECK_CLOSE(c.potential, potential, 100 * v.tolerance);
+        }
+    }
+}
+
+// Measuring moves force passes around but never changes their results.
+BOOST_AUTO_TEST_CASE(Universe_DiagnosticsDoNotPerturb) {
+    const NB::Integrator integrators[] = {
+        NB::Integrator::Euler, NB::Integrator::Leapfrog,
+        NB::Integrator::Yoshida4, NB::Integrator::RK4, NB::Integrator::Block
+    };
+    for (NB::Solver solver : {NB::Solver::Direct, NB::Solver::BarnesHut}) {
+        for (NB::Integrator integrator : integrators) {
+            Universe plain, measured;
+            makeCluster(plain, 300, 9);
+            makeCluster(measured, 300, 9);
+            for (Universe* universe : {&plain, &measured}) {
+                universe->setSolver(solver);
+                universe->setIntegrator(integrator);
+                universe->setSoftening(1e8);
+            }
+            measured.setDiagnosticsInterval(2);
+            for (int k = 0; k < 7; k++) {
+                plain.step(3600.0);
+                measured.step(3600.0);
+            }
+            // The pass that measured step 6 was reused by step 7.
+            BOOST_CHECK_EQUAL(measured.forceEvaluations(),
+                              plain.forceEvaluations());
+            measured.measureConservation();
+            plain.step(3600.0);
+            measured.step(3600.0);
+            BOOST_TEST_CONTEXT(NB::integratorName(integrator)) {
+                for (size_t i = 0; i < plain.size(); i++) {
+                    BOOST_REQUIRE_EQUAL(measured.state().x[i],
+                                        plain.state().x[i]);
+                    BOOST_REQUIRE_EQUAL(measured.state().vy[i],
+                                        plain.state().vy[i]);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ConservationMonitor_Tolerances) {
+    NB::Conservation start;
+    start.kinetic = 1.0;
+    start.potential = -3.0;
+    start.px = 1.0;
+    start.momentumScale = 10.0;
+    start.angular = 5.0;
+    start.angularScale = 5.0;
+
+    NB::ConservationMonitor monitor;
+    monitor.setEnergyTolerance(1e-3);
+    monitor.setMomentumTolerance(1e-6);
+    std::ostringstream out;
+    using Verdict = NB::ConservationMonitor::Verdict;
+    BOOST_CHECK(monitor.check(start, 0.0, 0, out) == Verdict::Ok);
+
+    NB::Conservation later = start;
+    later.kinetic += 1e-3;  // 5e-4 of |E|
+    later.px += 1e-6;
+    BOOST_CHECK(monitor.check(later, 1.0, 10, out) == Verdict::Ok);
+    BOOST_CHECK_CLOSE(monitor.energyDrift(), 5e-4, 1e-6);
+    BOOST_CHECK_CLOSE(monitor.momentumDrift(), 1e-7, 1e-6);
+    BOOST_CHECK_EQUAL(out.str().find("Warning"), std::string::npos);
+
+    later.angular -= 1e-4;
+    BOOST_CHECK(monitor.check(later, 2.0, 20, out) == Verdict::Flagged);
+    BOOST_CHECK(monitor.check(later, 3.0, 30, out) == Verdict::Flagged);
+    std::string text = out.str();
+    BOOST_CHECK_NE(text.find("Warning: angular momentum drift"),
+                   std::string::npos);
+    BOOST_CHECK_EQUAL(text.find("Warning", text.find("Warning") + 1),
+                      std::string::npos);
+
+    monitor.setAbort(true);
+    BOOST_CHECK(monitor.check(later, 4.0, 40, out) == Verdict::Abort);
+    BOOST_CHECK_EQUAL(monitor.samples(), 5u);
+}
+
+// A merge loses energy on purpose; the monitor measures from after it
+// instead of stopping the run.
+BOOST_AUTO_TEST_CASE(ConservationMonitor_Merges) {
+    CelestialBody::setLoadTextures(false);
+    struct Spec { double m, x, vx; };
+    const Spec specs[] = {
+        {2.0e24, -6.0e6, 2.0e4},
+        {6.0e24, 6.0e6, -2.0e4},
+        {1.0e22, 1.5e11, 0.0},
+    };
+    Universe universe;
+    universe.setRadius(2.0e11);
+    for (const Spec& spec : specs) {
+        auto body = std::make_shared<CelestialBody>();
+        body->setPreciseMass(spec.m);
+        body->setPrecisePosition({spec.x, 0.0});
+        body->setPreciseVelocity({spec.vx, 0.0});
+        body->setFileName("earth.gif");
+        universe.addToList(body);
+    }
+    universe.setSize(3);
+    universe.setCollisions(true);
+    universe.setIntegrator(NB::Integrator::Leapfrog);
+    universe.setDiagnosticsInterval(1);
+
+    NB::ConservationMonitor monitor;
+    monitor.setEnergyTolerance(1e-6);
+    monitor.setMomentumTolerance(1e-6);
+    monitor.setAbort(true);
+    std::ostringstream out;
+    using Verdict = NB::ConservationMonitor::Verdict;
+    BOOST_CHECK(monitor.check(universe.measureConservation(), 0.0, 0, out)
+                == Verdict::Ok);
+    for (uint64_t step = 1; step <= 100; step++) {
+        universe.step(1.0);
+        BOOST_REQUIRE(monitor.check(universe.conservation(), step * 1.0,
+                                    step, out) == Verdict::Ok);
+    }
+    CelestialBody::setLoadTextures(true);
+
+    BOOST_CHECK_EQUAL(universe.merges(), 1u);
+    BOOST_CHECK_EQUAL(monitor.reference().merges, 1u);
+    BOOST_CHECK_NE(out.str().find("reference reset"), std::string::npos);
+}